@@ -20,525 +20,808 @@
  * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include <queue>
 #include <iostream>
-#include <algorithm>
-#include <cassert>
-#include <map>
-#include <limits>
 #include <sstream>
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <chrono>
+#include <list>
 #include <math.h>
+#include <string.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/socket.h>
+#include <sys/un.h>
 
-#include <unordered_map>
+#include "labypath.hpp"
 
-#include "pgm.hpp"
+/**
+ * A line of a batch manifest: <input.ppm> <pinDist> <diameter> [switch]
+ */
+struct BatchJob {
+  std::string input;
+  double pinDist;
+  double diameter;
+  bool switchTopBottom;
+};
+
+//'skip' is set for empty lines and lines starting with '#'
+bool parseJob(const std::string& line, BatchJob& job, bool& skip) {
+  std::istringstream iss(line);
+  skip = !(iss >> job.input) || job.input[0] == '#';
+  if (skip) {
+    return true;
+  }
+  if (!(iss >> job.pinDist >> job.diameter)) {
+    return false;
+  }
+  std::string switchTopBottom;
+  job.switchTopBottom = (bool)(iss >> switchTopBottom);
+  return true;
+}
 
-struct Node {
-  Node (size_t topPos, size_t bottomPos, unsigned time): topPos(topPos), bottomPos(bottomPos), time(time) {
+bool readManifest(const char* filename, std::vector<BatchJob>& jobs) {
+  std::ifstream ifs(filename);
+  if (!ifs.good()) {
+    std::cerr << "Cannot open file '" << filename << "' for reading." << std::endl;
+    return false;
   }
+  std::string line;
+  for (unsigned lineNumber = 1; std::getline(ifs, line); ++lineNumber) {
+    BatchJob job;
+    bool skip;
+    if (!parseJob(line, job, skip)) {
+      std::cerr << filename << ":" << lineNumber << ": expected <input.ppm> <pinDist> <diameter> [switch]" << std::endl;
+      return false;
+    }
+    if (!skip) {
+      jobs.push_back(job);
+    }
+  }
+  return true;
+}
 
-  size_t topPos;
-  size_t bottomPos;
-  unsigned time;
+/**
+ * Solves the jobs with a breadth first search on each thread of the pool, and writes
+ * the path of job i (from 1) to <pathDir>/job<i>.path. With 'prune', each labyrinth is pruned
+ * for its ring first (see pruneLaby).
+ * Prints a line per job when it is done: <i> <input.ppm> <pinDist> <diameter> <s or -> <result> <seconds>
+ */
+void runBatch(const std::vector<BatchJob>& jobs, bool sweep, bool prune, const std::string& pathDir, WorkerPool& pool) {
+  //one solver per thread, that keeps its buffers from one job to the next
+  std::vector<std::unique_ptr<LabySolver> > solvers(pool.size());
+  std::mutex outputMutex;
+  size_t nextJob = 0;
+  pool.run([&](unsigned thread) {
+    solvers[thread].reset(new LabySolver());
+    LabySolver& solver = *solvers[thread];
+    solver.setSweep(sweep);
+    std::vector<PathStep> path;
+    for (;;) {
+      size_t i = __atomic_fetch_add(&nextJob, 1, __ATOMIC_RELAXED);
+      if (i >= jobs.size()) {
+        return;
+      }
+      const BatchJob& job = jobs[i];
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      std::ostringstream summary;
+      summary << i + 1 << " " << job.input << " " << job.pinDist << " " << job.diameter << " " << (job.switchTopBottom ? "s " : "- ");
+
+      Laby laby(job.input.c_str(), job.switchTopBottom);
+      Ring ring(job.pinDist, job.diameter, sqrt(2.0)/2.0);
+      LabySolver::Result result = laby.getWidth() == 0 ? LabySolver::InvalidStart :
+                                  (!prune || pruneLaby(laby, ring) ? solver.solve(laby, ring, path) : LabySolver::NotFound);
+      if (laby.getWidth() == 0) {
+        summary << "unreadable";
+      } else if (result == LabySolver::InvalidStart) {
+        summary << "incompatible";
+      } else if (result == LabySolver::Found) {
+        std::ostringstream filename;
+        filename << pathDir << "/job" << i + 1 << ".path";
+        std::ofstream ofs(filename.str().c_str());
+        printPath(ofs, laby, ring, path);
+        summary << (ofs.good() ? "found " : "unwritable ") << path.size() - 1;
+      } else {
+        summary << "none";
+      }
+      summary << " " << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+      std::unique_lock<std::mutex> lock(outputMutex);
+      std::cout << summary.str() << std::endl;
+    }
+  });
+}
 
-  bool operator <(const Node& other) const {
-    return time > other.time;
+/**
+ * Parses "min:max:step" into the values from min to max included, or a single value.
+ */
+bool parseRange(const char* arg, std::vector<double>& values) {
+  std::istringstream iss(arg);
+  double min, max, step = 1.0;
+  char colon1 = ':', colon2 = ':';
+  if (!(iss >> min)) {
+    return false;
   }
+  max = min;
+  if (!iss.eof() && (!(iss >> colon1 >> max >> colon2 >> step) || !iss.eof())) {
+    return false;
+  }
+  if (colon1 != ':' || colon2 != ':' || step <= 0.0 || max < min) {
+    return false;
+  }
+  values.clear();
+  for (unsigned i = 0; min + i * step <= max + 1e-6 * step; ++i) {
+    values.push_back(min + i * step);
+  }
+  return true;
+}
 
-  private:
-    Node();
-};
+/**
+ * Solves the labyrinth for every (pinDist, diameter) pair on the threads of the pool, and prints
+ * the path lengths as a matrix with a line per pinDist and a column per diameter:
+ * '-' when there is no path, 'x' when the start position does not fit the ring.
+ * The labyrinth is decoded once for all, and with 'prune', each pair solves a copy pruned
+ * for its ring (see pruneLaby). The ring offsets are computed once for each different annulus,
+ * then only get the ring point of each diameter.
+ */
+void runScan(const Laby& laby, const std::vector<double>& pins, const std::vector<double>& diameters, bool sweep, bool prune,
+             WorkerPool& pool) {
+  const double tolerance = sqrt(2.0)/2.0;
+  std::vector<std::unique_ptr<RingOffsets> > annuli;
+  std::vector<unsigned> annulusOf(pins.size());
+  for (unsigned p = 0; p < pins.size(); ++p) {
+    std::unique_ptr<RingOffsets> offsets(new RingOffsets(Ring(pins[p], diameters[0], tolerance)));
+    for (annulusOf[p] = 0; annulusOf[p] < annuli.size() && !annuli[annulusOf[p]]->sameOffsets(*offsets); ++annulusOf[p]) {
+    }
+    if (annulusOf[p] == annuli.size()) {
+      annuli.push_back(std::move(offsets));
+    }
+  }
+  std::cerr << annuli.size() << " ring offset tables for " << pins.size() << " pin distances" << std::endl;
+
+  std::vector<std::string> results(pins.size() * diameters.size());
+  std::vector<std::unique_ptr<LabySolver> > solvers(pool.size());
+  std::mutex logMutex;
+  size_t nextJob = 0;
+  pool.run([&](unsigned thread) {
+    solvers[thread].reset(new LabySolver());
+    LabySolver& solver = *solvers[thread];
+    solver.setSweep(sweep);
+    std::vector<PathStep> path;
+    for (;;) {
+      size_t i = __atomic_fetch_add(&nextJob, 1, __ATOMIC_RELAXED);
+      if (i >= results.size()) {
+        return;
+      }
+      unsigned p = i / diameters.size();
+      unsigned d = i % diameters.size();
+      Ring ring(pins[p], diameters[d], tolerance);
+      RingOffsets offsets(*annuli[annulusOf[p]], ring);
+      LabySolver::Result result;
+      if (prune) {
+        Laby pruned(laby);
+        result = pruneLaby(pruned, ring, offsets) ? solver.solve(pruned, ring, offsets, path) : LabySolver::NotFound;
+      } else {
+        result = solver.solve(laby, ring, offsets, path);
+      }
+      if (result == LabySolver::InvalidStart) {
+        results[i] = "x";
+      } else if (result == LabySolver::Found) {
+        std::ostringstream steps;
+        steps << path.size() - 1;
+        results[i] = steps.str();
+      } else {
+        results[i] = "-";
+      }
+      std::unique_lock<std::mutex> lock(logMutex);
+      std::cerr << "pinDist " << pins[p] << " diameter " << diameters[d] << ": " << results[i] << std::endl;
+    }
+  });
+
+  std::cout << "pinDist\\diameter";
+  for (unsigned d = 0; d < diameters.size(); ++d) {
+    std::cout << "\t" << diameters[d];
+  }
+  std::cout << std::endl;
+  for (unsigned p = 0; p < pins.size(); ++p) {
+    std::cout << pins[p];
+    for (unsigned d = 0; d < diameters.size(); ++d) {
+      std::cout << "\t" << results[p * diameters.size() + d];
+    }
+    std::cout << std::endl;
+  }
+}
 
-class Ring {
+/**
+ * Writes the counters of a search (see SearchStats) to a file, as CSV, or as a JSON
+ * object per line if the file name ends with '.json'. A record is written at most
+ * every 'interval' seconds, with the number of states expanded per second since the
+ * previous record.
+ */
+class StatsLog {
   public:
-    Ring(double interPinDistance, double diameter, double tolerance)
-     : _interPinDistance(interPinDistance), _diameter(diameter), _tolerance(tolerance) {
-    }
-
-    template <class LabyT>
-    bool validatePinPos(double topX, double topY, double bottomX, double bottomY, const LabyT& laby) const {
-      if ( (topX - bottomX)*(topX - bottomX) + (topY - bottomY)*(topY - bottomY) < (_interPinDistance + _tolerance) * (_interPinDistance + _tolerance) &&
-             (topX - bottomX)*(topX - bottomX) + (topY - bottomY)*(topY - bottomY) > (_interPinDistance - _tolerance) * (_interPinDistance - _tolerance)) {
-        //first check OK, now check that the ring does not intersect the laby.
-        double vx = (topX - bottomX) / _interPinDistance;
-        double vy = (topY - bottomY) / _interPinDistance;
-        int x = (unsigned)(bottomX + vx * _diameter + 0.5);
-        int y = (unsigned)(bottomY + vy * _diameter + 0.5);
-        if (x >= 0 && x < (int)laby.getWidth() && y >= 0 && y < (int)laby.getHeight()) {
-          return laby.atTop(laby.coordsToPos(x, y)) != LabyT::Path && laby.atBottom(laby.coordsToPos(x, y)) != LabyT::Path;
-        } else {
-          return true;
-        }
-      } else {
+    StatsLog(): _json(false), _interval(0), _begin(std::chrono::steady_clock::now()), _lastSeconds(-1), _lastExpanded(0) {
+    }
+
+    bool open(const std::string& filename, double interval) {
+      _ofs.open(filename.c_str());
+      if (!_ofs.good()) {
+        std::cerr << "Cannot open file '" << filename << "' for writing." << std::endl;
         return false;
       }
+      _json = filename.size() >= 5 && filename.compare(filename.size() - 5, 5, ".json") == 0;
+      _interval = interval;
+      if (!_json) {
+        _ofs << "seconds,phase,time,frontier,expanded,moves,out_of_bounds,wall,distance,ring,sweep,"
+                "visited_hits,peak_frontier,store_bytes,nodes_per_second\n";
+      }
+      return true;
     }
 
-    double getPinDistance() const {
-      return _interPinDistance;
+    //'phase' is the name given to the Progress, or "done"; only writes if the interval is over, or if 'force'
+    void write(const char* phase, unsigned time, size_t frontier, const SearchStats& stats, bool force) {
+      double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - _begin).count();
+      if (!force && _lastSeconds >= 0 && seconds - _lastSeconds < _interval) {
+        return;
+      }
+      double elapsed = seconds - std::max(_lastSeconds, 0.0);
+      double rate = elapsed > 0 ? (stats.expanded - _lastExpanded) / elapsed : 0;
+      _lastSeconds = seconds;
+      _lastExpanded = stats.expanded;
+      if (_json) {
+        _ofs << "{\"seconds\": " << seconds << ", \"phase\": \"" << phase << "\", \"time\": " << time
+             << ", \"frontier\": " << frontier << ", \"expanded\": " << stats.expanded << ", \"moves\": " << stats.moves
+             << ", \"out_of_bounds\": " << stats.outOfBounds << ", \"wall\": " << stats.wall << ", \"distance\": " << stats.distance
+             << ", \"ring\": " << stats.ring << ", \"sweep\": " << stats.sweep << ", \"visited_hits\": " << stats.visitedHits
+             << ", \"peak_frontier\": " << stats.peakFrontier << ", \"store_bytes\": " << stats.storeBytes
+             << ", \"nodes_per_second\": " << (uint64_t)rate << "}\n";
+      } else {
+        _ofs << seconds << "," << phase << "," << time << "," << frontier << "," << stats.expanded << "," << stats.moves
+             << "," << stats.outOfBounds << "," << stats.wall << "," << stats.distance << "," << stats.ring << "," << stats.sweep
+             << "," << stats.visitedHits << "," << stats.peakFrontier << "," << stats.storeBytes << "," << (uint64_t)rate << "\n";
+      }
+      if (force) {
+        _ofs.flush();
+      }
     }
 
-    double getDiameter() const {
-      return _diameter;
+  private:
+    std::ofstream _ofs;
+    bool _json;
+    double _interval;
+    std::chrono::steady_clock::time_point _begin;
+    double _lastSeconds;
+    uint64_t _lastExpanded;
+};
+
+/**
+ * The 'capacity' values used last, by key.
+ */
+template <class Value>
+class LruCache {
+  public:
+    LruCache(size_t capacity): _capacity(std::max(capacity, (size_t)1)) {
     }
 
-  private:
-    double _interPinDistance;
-    double _diameter;
-    double _tolerance;
+    //NULL if key is not in the cache, else the value, which becomes the most recently used
+    Value* get(const std::string& key) {
+      typename Index::iterator it = _index.find(key);
+      if (it == _index.end()) {
+        return NULL;
+      }
+      _entries.splice(_entries.begin(), _entries, it->second);
+      return &it->second->second;
+    }
+
+    //key must not be in the cache; evicts the least recently used value if the cache is full
+    Value& put(const std::string& key, Value value) {
+      _entries.push_front(std::make_pair(key, std::move(value)));
+      _index[key] = _entries.begin();
+      if (_entries.size() > _capacity) {
+        _index.erase(_entries.back().first);
+        _entries.pop_back();
+      }
+      return _entries.front().second;
+    }
 
-    Ring();
+  private:
+    typedef std::list<std::pair<std::string, Value> > Entries;
+    typedef std::unordered_map<std::string, typename Entries::iterator> Index;
+    size_t _capacity;
+    Entries _entries;
+    Index _index;
 };
 
+//FNV-1a hash of the contents of a file, false if it cannot be read
+bool hashFile(const char* filename, uint64_t& hash) {
+  std::ifstream ifs(filename, std::ifstream::in | std::ifstream::binary);
+  if (!ifs.good()) {
+    return false;
+  }
+  hash = 14695981039346656037ULL;
+  char buffer[1 << 16];
+  while (ifs.read(buffer, sizeof(buffer)) || ifs.gcount() > 0) {
+    for (std::streamsize i = 0; i < ifs.gcount(); ++i) {
+      hash = (hash ^ (unsigned char)buffer[i]) * 1099511628211ULL;
+    }
+  }
+  return true;
+}
+
 /**
- * The labyrinth;
+ * Answers solve requests, one '<input.ppm> <pinDist> <diameter> [switch]' per line,
+ * with 'found <steps>' followed by the path, or with a line 'none', 'unreadable',
+ * 'incompatible' or 'error <message>'.
  *
+ * Parsed labyrinths are kept by hash of the file contents, so a labyrinth is read again
+ * only when its file changes, and the state encoding tables by labyrinth and ring, so a
+ * repeated request only runs the search. With 'prune', the tables of a ring are built on a
+ * copy of the labyrinth pruned for it (see pruneLaby), and a ring with no path is answered
+ * without searching.
  */
-struct Laby {
-public:
-  enum CellType { Path = 255, Wall = 0, Exit=254};
-  static const size_t InvalidPos = 0xffffffff;
-
-  Laby(unsigned width, unsigned height): _w(width), _h(height) {
-    _topMap.resize(_w*_h, Path);
-    _bottomMap.resize(_w*_h, Path);
-  }
-
-  //create from pnm
-  Laby(const char* filename, bool switchTopBottom) {
-    //read PGM
-    std::vector<unsigned char> data;
-    if (PnmReader::read(filename, _w, _h, data, &std::cerr)) {
-      _topMap.resize(_w*_h, Path);
-      _bottomMap.resize(_w*_h, Path);
-      if (switchTopBottom) {
-        for (unsigned i = 0; i < _w*_h; ++i) {
-          //red is bottom, green is top
-          // >128 is path, <128 is wall
-          // blue=255 is exit
-          if (data[3*i] > 128) {
-            _bottomMap[i] = Path;
-          } else {
-            _bottomMap[i] = Wall;
-          }
-          if (data[3*i + 1] > 128) {
-            _topMap[i] = Path;
-          } else {
-            _topMap[i] = Wall;
-          }
-          if (data[3*i + 2] == 255) {
-            _bottomMap[i] = Exit;
-            _topMap[i] = Exit;
-          }
+class SolveServer {
+  public:
+    SolveServer(LabySolver& solver, bool sweep, bool prune, size_t cacheSize)
+     : _solver(solver), _sweep(sweep), _prune(prune), _mazes(cacheSize), _tables(cacheSize) {
+    }
+
+    //answers the requests read from in until its end (returns true) or a 'quit' line (returns false)
+    bool serve(FILE* in, FILE* out) {
+      char* buffer = NULL;
+      size_t size = 0;
+      bool running = true;
+      for (ssize_t length; running && (length = getline(&buffer, &size, in)) >= 0;) {
+        std::string line(buffer, length);
+        while (!line.empty() && (line[line.size() - 1] == '\n' || line[line.size() - 1] == '\r')) {
+          line.resize(line.size() - 1);
+        }
+        if (line == "quit") {
+          running = false;
+        } else {
+          std::string response = answer(line);
+          fwrite(response.data(), 1, response.size(), out);
+          fflush(out);
         }
+      }
+      free(buffer);
+      return running;
+    }
+
+  private:
+    //a labyrinth, pruned for the ring or not, and the tables of the ring, which refer to it
+    struct Tables {
+      std::shared_ptr<Laby> laby;
+      std::shared_ptr<StateEncoding> states;
+      //false if pruning found that there is no path
+      bool connected;
+    };
+
+    std::string answer(const std::string& line) {
+      BatchJob job;
+      bool skip;
+      if (!parseJob(line, job, skip)) {
+        return "error expected <input.ppm> <pinDist> <diameter> [switch]\n";
+      }
+      if (skip) {
+        return "";
+      }
+      std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+      std::ostringstream log, response;
+      log << job.input << " " << job.pinDist << " " << job.diameter << " " << (job.switchTopBottom ? "s" : "-");
+
+      uint64_t hash;
+      if (!hashFile(job.input.c_str(), hash)) {
+        response << "unreadable\n";
+        log << " unreadable";
       } else {
-        for (unsigned i = 0; i < _w*_h; ++i) {
-          //red is top, green is bottom
-          // >128 is path, <128 is wall
-          // blue=255 is exit
-          if (data[3*i] > 128) {
-            _topMap[i] = Path;
-          } else {
-            _topMap[i] = Wall;
-          }
-          if (data[3*i + 1] > 128) {
-            _bottomMap[i] = Path;
-          } else {
-            _bottomMap[i] = Wall;
+        std::ostringstream mazeKey, tablesKey;
+        mazeKey << std::hex << hash << (job.switchTopBottom ? " s" : " -");
+        tablesKey.precision(17);
+        tablesKey << mazeKey.str() << " " << job.pinDist << " " << job.diameter;
+        Ring ring(job.pinDist, job.diameter, sqrt(2.0)/2.0);
+
+        Tables* tables = _tables.get(tablesKey.str());
+        log << (tables ? " tables cached" : "");
+        if (!tables) {
+          std::shared_ptr<Laby>* laby = _mazes.get(mazeKey.str());
+          log << (laby ? " labyrinth cached" : "");
+          if (!laby) {
+            std::shared_ptr<Laby> parsed = std::make_shared<Laby>(job.input.c_str(), job.switchTopBottom);
+            if (parsed->getWidth() > 0) {
+              laby = &_mazes.put(mazeKey.str(), parsed);
+            }
           }
-          if (data[3*i + 2] == 255) {
-            _bottomMap[i] = Exit;
-            _topMap[i] = Exit;
+          if (laby) {
+            Tables built;
+            built.laby = *laby;
+            built.connected = true;
+            if (_prune) {
+              built.laby = std::make_shared<Laby>(**laby);
+              built.connected = pruneLaby(*built.laby, ring);
+            }
+            built.states = std::make_shared<StateEncoding>(*built.laby, ring, _sweep);
+            tables = &_tables.put(tablesKey.str(), built);
           }
         }
+
+        std::vector<PathStep> path;
+        LabySolver::Result result = !tables ? LabySolver::InvalidStart :
+                                    (tables->connected ? _solver.solve(*tables->states, ring, path) : LabySolver::NotFound);
+        if (!tables) {
+          response << "unreadable\n";
+          log << " unreadable";
+        } else if (result == LabySolver::InvalidStart) {
+          response << "incompatible\n";
+          log << " incompatible";
+        } else if (result == LabySolver::Found) {
+          response << "found " << path.size() - 1 << "\n";
+          printPath(response, *tables->laby, ring, path);
+          log << " found " << path.size() - 1;
+        } else {
+          response << "none\n";
+          log << " none";
+        }
       }
-    } else {
-      _w = 0;
-      _h = 0;
+      std::cerr << log.str() << " " << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << std::endl;
+      return response.str();
     }
-  }
 
-  unsigned getWidth() const {
-    return _w;
-  }
+    LabySolver& _solver;
+    bool _sweep;
+    bool _prune;
+    LruCache<std::shared_ptr<Laby> > _mazes;
+    LruCache<Tables> _tables;
+};
 
-  unsigned getHeight() const {
-    return _h;
+//false if path does not fit in a sockaddr_un
+bool socketAddress(const char* path, sockaddr_un& address) {
+  memset(&address, 0, sizeof(address));
+  address.sun_family = AF_UNIX;
+  if (strlen(path) >= sizeof(address.sun_path)) {
+    std::cerr << "Socket path '" << path << "' is too long" << std::endl;
+    return false;
   }
+  strcpy(address.sun_path, path);
+  return true;
+}
 
-  CellType atTop(size_t pos) const {
-    return _bottomMap[pos];
+//serves the connections to the unix socket at path one after the other, until a 'quit' request
+void serveSocket(SolveServer& server, const char* path) {
+  sockaddr_un address;
+  if (!socketAddress(path, address)) {
+    return;
   }
-
-  CellType atBottom(size_t pos) const {
-    return _topMap[pos];
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  unlink(path);
+  if (fd < 0 || bind(fd, (sockaddr*)&address, sizeof(address)) != 0 || listen(fd, 16) != 0) {
+    std::cerr << "Cannot listen on '" << path << "': " << strerror(errno) << std::endl;
+    if (fd >= 0) {
+      close(fd);
+    }
+    return;
   }
-
-  size_t coordsToPos(unsigned x, unsigned y) const {
-    assert(y < _h);
-    assert(x < _w);
-    return _w*y + x;
+  std::cerr << "Listening on " << path << std::endl;
+  for (bool running = true; running;) {
+    int connection = accept(fd, NULL, NULL);
+    if (connection < 0) {
+      if (errno == EINTR) {
+        continue;
+      }
+      std::cerr << "accept: " << strerror(errno) << std::endl;
+      break;
+    }
+    FILE* in = fdopen(connection, "r");
+    FILE* out = fdopen(dup(connection), "w");
+    running = server.serve(in, out);
+    fclose(in);
+    fclose(out);
   }
+  close(fd);
+  unlink(path);
+}
 
-  void posToCoords(size_t pos, unsigned &x, unsigned &y) const {
-    assert(pos != InvalidPos);
-    x = pos % _w;
-    y = pos / _w;
+/**
+ * Sends request to the server at the unix socket path, and prints its answer like
+ * laby would: the path on std::cout, and the status on std::cerr.
+ */
+void runClient(const char* path, const std::string& request) {
+  sockaddr_un address;
+  if (!socketAddress(path, address)) {
+    return;
   }
-
-  size_t left(size_t pos) const {
-    if (pos == InvalidPos) {
-      return InvalidPos;
-    }
-    unsigned x, y;
-    posToCoords(pos, x, y);
-    if (x > 0) {
-      return coordsToPos(x - 1, y);
-    } else {
-      return InvalidPos;
+  int fd = socket(AF_UNIX, SOCK_STREAM, 0);
+  if (fd < 0 || connect(fd, (sockaddr*)&address, sizeof(address)) != 0) {
+    std::cerr << "Cannot connect to '" << path << "': " << strerror(errno) << std::endl;
+    if (fd >= 0) {
+      close(fd);
     }
+    return;
   }
-
-  size_t right(size_t pos) const {
-    if (pos == InvalidPos) {
-      return InvalidPos;
-    }
-    unsigned x, y;
-    posToCoords(pos, x, y);
-    if (x < _w - 1) {
-      return coordsToPos(x + 1, y);
-    } else {
-      return InvalidPos;
-    }
+  std::string line = request + "\n";
+  bool sent = write(fd, line.data(), line.size()) == (ssize_t)line.size();
+  shutdown(fd, SHUT_WR);
+  std::string response;
+  char buffer[1 << 16];
+  for (ssize_t n; sent && (n = read(fd, buffer, sizeof(buffer))) > 0;) {
+    response.append(buffer, n);
   }
-
-  size_t up(size_t pos) const {
-    if (pos == InvalidPos) {
-      return InvalidPos;
-    }
-    unsigned x, y;
-    posToCoords(pos, x, y);
-    if (y > 0) {
-      return coordsToPos(x, y - 1);
-    } else  {
-      return InvalidPos;
-    }
+  close(fd);
+  if (request == "quit") {
+    return;
   }
 
-  size_t down(size_t pos) const {
-    if (pos == InvalidPos) {
-      return InvalidPos;
-    }
-    unsigned x, y;
-    posToCoords(pos, x, y);
-    if (y < _h - 1) {
-      return coordsToPos(x, y + 1);
-    } else  {
-      return InvalidPos;
-    }
+  size_t endOfStatus = response.find('\n');
+  std::string status = response.substr(0, endOfStatus);
+  if (status.compare(0, 6, "found ") == 0) {
+    std::cerr << "Found path in " << status.substr(6) << " steps" << std::endl;
+    std::cout << response.substr(endOfStatus + 1);
+  } else if (status == "none") {
+    std::cerr << "Path not found" << std::endl;
+  } else if (status == "incompatible") {
+    std::cerr << "Start position is not compatible with the ring" << std::endl;
+  } else if (status == "unreadable") {
+    std::cerr << "Cannot read the labyrinth" << std::endl;
+  } else {
+    std::cerr << "Server answered '" << status << "'" << std::endl;
   }
+}
 
-  template <class Ring>
-  bool validate(size_t topPos, size_t bottomPos, Ring& ring) const {
-    assert(topPos != InvalidPos);
-    assert(bottomPos != InvalidPos);
-    if (_topMap[topPos] == Wall || _bottomMap[bottomPos] == Wall) {
-      //positions must be in a path
-      return false;
+int main(int argc, char **argv) {
+  std::vector<const char*> args;
+  std::string visited;
+  bool bidirectional = false;
+  bool aStar = false;
+  bool sweep = false;
+  std::string drawFile;
+  std::string manifest;
+  std::string pathDir = ".";
+  std::string clientSocket;
+  std::string serveSocketPath;
+  bool serve = false;
+  size_t cacheSize = 8;
+  std::string checkpoint;
+  unsigned checkpointInterval = 600;
+  bool resume = false;
+  std::string tmpDir = ".";
+  size_t memory = 1024;
+  bool quiet = false;
+  std::string statsFile;
+  double statsInterval = 1;
+  std::string saveFile;
+  bool runLength = false;
+  bool prune = true;
+  unsigned levels = 0;
+  unsigned band = 4;
+  unsigned nThreads = 0;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 10, "--visited=") == 0) {
+      visited = arg.substr(10);
+    } else if (arg == "--bidirectional") {
+      bidirectional = true;
+    } else if (arg == "--astar") {
+      aStar = true;
+    } else if (arg == "--sweep") {
+      sweep = true;
+    } else if (arg.compare(0, 7, "--draw=") == 0) {
+      drawFile = arg.substr(7);
+    } else if (arg.compare(0, 8, "--batch=") == 0) {
+      manifest = arg.substr(8);
+    } else if (arg.compare(0, 8, "--paths=") == 0) {
+      pathDir = arg.substr(8);
+    } else if (arg == "--serve") {
+      serve = true;
+    } else if (arg.compare(0, 8, "--serve=") == 0) {
+      serve = true;
+      serveSocketPath = arg.substr(8);
+    } else if (arg.compare(0, 9, "--client=") == 0) {
+      clientSocket = arg.substr(9);
+    } else if (arg.compare(0, 13, "--checkpoint=") == 0) {
+      checkpoint = arg.substr(13);
+    } else if (arg.compare(0, 19, "--checkpoint-every=") == 0) {
+      checkpointInterval = atoi(arg.substr(19).c_str());
+    } else if (arg.compare(0, 9, "--tmpdir=") == 0) {
+      tmpDir = arg.substr(9);
+    } else if (arg.compare(0, 9, "--memory=") == 0) {
+      memory = atoi(arg.substr(9).c_str());
+    } else if (arg.compare(0, 7, "--save=") == 0) {
+      saveFile = arg.substr(7);
+    } else if (arg == "--rle") {
+      runLength = true;
+    } else if (arg.compare(0, 9, "--levels=") == 0) {
+      levels = atoi(arg.substr(9).c_str());
+    } else if (arg.compare(0, 7, "--band=") == 0) {
+      band = atoi(arg.substr(7).c_str());
+    } else if (arg == "--no-prune") {
+      prune = false;
+    } else if (arg == "--quiet") {
+      quiet = true;
+    } else if (arg.compare(0, 8, "--stats=") == 0) {
+      statsFile = arg.substr(8);
+    } else if (arg.compare(0, 14, "--stats-every=") == 0) {
+      statsInterval = atof(arg.substr(14).c_str());
+    } else if (arg == "--resume") {
+      resume = true;
+    } else if (arg.compare(0, 8, "--cache=") == 0) {
+      cacheSize = atoi(arg.substr(8).c_str());
+    } else if (arg == "-j" && i + 1 < argc) {
+      nThreads = atoi(argv[++i]);
     } else {
-      unsigned xTop, xBottom, yTop, yBottom;
-      posToCoords(topPos, xTop, yTop);
-      posToCoords(bottomPos, xBottom, yBottom);
-      return ring.validatePinPos(xTop, yTop, xBottom, yBottom, *this);
+      args.push_back(argv[i]);
     }
   }
 
-  void draw(std::vector<unsigned char> &data, size_t topPos, size_t bottomPos) const {
-    data.resize(0);
-    data.reserve(_w*_h*3);
-    for (unsigned i = 0; i < _w*_h; ++i) {
-      data.push_back(_topMap[i]); //R
-      data.push_back(_bottomMap[i]); //G
-      data.push_back((_topMap[i] == Exit)*255); //B
-    }
-    data[3 * topPos] = 0;
-    data[3 * topPos + 1] = 0;
-    data[3 * topPos + 2] = 255;
-    data[3 * bottomPos] = 0;
-    data[3 * bottomPos + 1] = 0;
-    data[3 * bottomPos + 2] = 255;
+  if (visited.empty()) {
+    visited = aStar ? "hash" : "dense";
   }
-
-
-private:
-
-  double dist();
-
-  unsigned _w;
-  unsigned _h;
-  std::vector<CellType> _topMap;
-  std::vector<CellType> _bottomMap;
-};
-
-struct VisitedPos {
-    VisitedPos(): time(0xffffffff), prevObjOffset(std::numeric_limits<size_t>::max()) {
+  if (!clientSocket.empty()) {
+    if (args.size() == 1 && strcmp(args[0], "quit") == 0) {
+      runClient(clientSocket.c_str(), "quit");
+      return 0;
+    }
+    if (args.size() >= 3) {
+      //the server may run in another directory
+      char* input = realpath(args[0], NULL);
+      std::ostringstream request;
+      request << (input ? input : args[0]) << " " << args[1] << " " << args[2] << (args.size() > 3 ? " switch" : "");
+      free(input);
+      runClient(clientSocket.c_str(), request.str());
+      return 0;
     }
-    unsigned time;
-    size_t prevObjOffset; //'pointer' to previous visited pos
-};
-
-struct VisitedPositionsHashMap {
-  VisitedPositionsHashMap(unsigned size): _size(size) {
   }
-
-  bool operator() (size_t topPos, size_t bottomPos, unsigned time) const {
-    std::unordered_map<size_t, VisitedPos>::const_iterator it = _visited.find(_size*topPos + bottomPos);
-    return it != _visited.end() && it->second.time <= time;
+  if ((args.size() < 3 && manifest.empty() && !serve) || !clientSocket.empty() || (visited != "hash" && visited != "dense" && visited != "disk")) {
+    std::cerr << "Usage: laby [--visited=hash|dense|disk [--tmpdir=dir] [--memory=MB]] [--bidirectional | --astar] [--sweep] [--no-prune] [--draw=image.ppm] [-j threads]" << std::endl;
+    std::cerr << "            [--levels=n [--band=cells]] [--checkpoint=file [--checkpoint-every=seconds] [--resume]] [--quiet] [--stats=file.csv|file.json [--stats-every=seconds]]" << std::endl;
+    std::cerr << "            [--save=path.lpath [--rle]] <input.ppm> <pinDist> <diameter> [switch]" << std::endl;
+    std::cerr << "       pinDist and diameter can be ranges: min:max:step" << std::endl;
+    std::cerr << "       laby --batch=manifest [--paths=dir] [--sweep] [--no-prune] [-j threads]" << std::endl;
+    std::cerr << "       laby --serve[=socket] [--cache=n] [solver options]" << std::endl;
+    std::cerr << "       laby --client=socket <input.ppm> <pinDist> <diameter> [switch] | quit" << std::endl;
+    return 0;
   }
-
-  void set(size_t topPos, size_t bottomPos, unsigned time, size_t prevTopPos, size_t prevBottomPos) {
-    assert(!(*this)(topPos, bottomPos, time));
-    _visited[_size*topPos + bottomPos].time = time;
-    _visited[_size*topPos + bottomPos].prevObjOffset = _size*prevTopPos + prevBottomPos;
+  if (!manifest.empty()) {
+    if (visited != "dense" || bidirectional || aStar) {
+      std::cerr << "--batch only works with --visited=dense and without --bidirectional or --astar" << std::endl;
+      return 0;
+    }
+    std::vector<BatchJob> jobs;
+    if (!readManifest(manifest.c_str(), jobs)) {
+      return 0;
+    }
+    WorkerPool pool(std::max(nThreads, 1u));
+    runBatch(jobs, sweep, prune, pathDir, pool);
+    return 0;
   }
-
-  void setOrigin(size_t topPos, size_t bottomPos) {
-    _visited[_size*topPos + bottomPos].time = 0;
-    _visited[_size*topPos + bottomPos].prevObjOffset = std::numeric_limits<size_t>::max();
+  if (nThreads > 0 && (visited != "dense" || bidirectional || aStar)) {
+    std::cerr << "-j only works with --visited=dense and without --bidirectional or --astar" << std::endl;
+    return 0;
   }
-
-  size_t offsetOf(size_t topPos, size_t bottomPos) const {
-    return _size*topPos + bottomPos;
+  if (aStar && (visited != "hash" || bidirectional)) {
+    std::cerr << "--astar only works with --visited=hash and without --bidirectional" << std::endl;
+    return 0;
   }
-
-  void posOf(size_t offset, size_t &topPos, size_t &bottomPos) const {
-    topPos = offset / _size;
-    bottomPos = offset - topPos * _size;
+  if (visited == "disk" && bidirectional) {
+    std::cerr << "--visited=disk only works without --bidirectional" << std::endl;
+    return 0;
   }
-
-  const VisitedPos& atOffset(size_t offset) const {
-    std::unordered_map<size_t, VisitedPos>::const_iterator it = _visited.find(offset);
-    assert(it != _visited.end());
-    return it->second;
+  if ((!checkpoint.empty() || resume) && (checkpoint.empty() || visited != "dense" || bidirectional || serve || levels > 0)) {
+    std::cerr << "--checkpoint only works with --visited=dense and without --bidirectional, --serve or --levels, --resume needs --checkpoint" << std::endl;
+    return 0;
   }
-
-  private:
-    std::unordered_map<size_t, VisitedPos> _visited;
-    size_t _size;
-};
-
-template <class VisitedPositions>
-void backtrackToStart(const Laby& laby, const Ring& ring, const VisitedPositions& beenThere, size_t topPos, size_t bottomPos) {
-  std::vector<unsigned char> data;
-  for(size_t offset = beenThere.offsetOf(topPos, bottomPos); offset != std::numeric_limits<size_t>::max(); ) {
-    const VisitedPos &vp = beenThere.atOffset(offset);
-    size_t tPos, bPos;
-    beenThere.posOf(offset, tPos, bPos);
-    {
-      unsigned xt, yt, xb, yb;
-      laby.posToCoords(tPos, xt, yt);
-      laby.posToCoords(bPos, xb, yb);
-      std::cout << vp.time;
-      //write center and angle.
-      float vtbx = ((float)xt - (float)xb) / laby.getWidth();
-      float vtby = ((float)yt - (float)yb) / laby.getHeight();
-      float vNorm = sqrt(vtbx * vtbx + vtby * vtby);
-      vtbx /= vNorm;
-      vtby /= vNorm;
-      std::cout << " " << (float)xt / laby.getWidth() << " " << (float)yt / laby.getHeight();
-      std::cout << " " << (float)xb / laby.getWidth() << " " << (float)yb / laby.getHeight();
-      float rx = (xb + vtbx * ring.getDiameter())/ (float)laby.getWidth() ;
-      float ry = (yb + vtby * ring.getDiameter())/ (float)laby.getHeight() ;
-      std::cout << " " << rx << " " << ry;
-      std::cout << std::endl;
-    }
-    offset = vp.prevObjOffset;
+  if (levels > 0 && serve) {
+    std::cerr << "--levels only works without --serve" << std::endl;
+    return 0;
   }
-}
 
-int main(int argc, char **argv) {
-  std::priority_queue<Node> queue;
-
-  if (argc < 4) {
-    std::cerr << "Usage: laby <input.ppm> <pinDist> <diameter> [switch]" << std::endl;
+  LabySolver solver;
+  solver.setMethod(aStar ? LabySolver::AStar : (bidirectional ? LabySolver::Bidirectional : LabySolver::BreadthFirst));
+  solver.setStore(visited == "hash" ? LabySolver::Hash : (visited == "disk" ? LabySolver::Disk : LabySolver::Dense));
+  solver.setDiskStore(tmpDir, memory << 20);
+  solver.setSweep(sweep);
+  solver.setThreads(nThreads);
+  solver.setCheckpoint(checkpoint, checkpointInterval, resume);
+  solver.setLevels(levels, band);
+  if (serve) {
+    SolveServer server(solver, sweep, prune, cacheSize);
+    if (serveSocketPath.empty()) {
+      server.serve(stdin, stdout);
+    } else {
+      serveSocket(server, serveSocketPath.c_str());
+    }
     return 0;
   }
 
-  double pinDist = atof(argv[2]);
-  double diameter = atof(argv[3]);
+  double pinDist = atof(args[1]);
+  double diameter = atof(args[2]);
 
   bool switchTB = false;
-  if (argc > 4) {
+  if (args.size() > 3) {
     switchTB = true;
   }
 
-  Laby laby(argv[1], switchTB);
-  unsigned width = laby.getWidth();
-  unsigned height = laby.getHeight();
+  Laby laby(args[0], switchTB);
 
-  Ring ring(pinDist, diameter, sqrt(2.0)/2.0);
-  VisitedPositionsHashMap beenThereBefore(width*height);
-  size_t startTopPos = laby.coordsToPos(0, 0);
-  size_t startBottomPos = laby.coordsToPos(0, (unsigned)ring.getPinDistance());
-
-  queue.push(Node(startTopPos, startBottomPos, 0));
-  beenThereBefore.setOrigin(startTopPos, startBottomPos);
-
-
-  unsigned lastTime = 0;
-  while (!queue.empty()) {
-    Node current = queue.top();
-    queue.pop();
-    if (lastTime != current.time) {
-      lastTime = current.time;
-      unsigned x, y;
-      std::cerr << "time: " << current.time << " pos (" << current.topPos << " " << current.bottomPos << ") = ";
-      laby.posToCoords(current.topPos, x, y);
-      std::cerr << "(" << x << "," <<  y<< ")";
-      laby.posToCoords(current.bottomPos, x, y);
-      std::cerr << " (" << x << "," <<  y<< ")" << std::endl;
-      std::cerr << "  nodes: " << queue.size() << std::endl;
-    }
-    if (laby.atTop(current.topPos) == Laby::Exit && laby.atBottom(current.bottomPos) == Laby::Exit) {
-      std::cerr << "Found path in " << current.time << " steps" << std::endl;
-      backtrackToStart(laby, ring, beenThereBefore, current.topPos, current.bottomPos);
+  if (strchr(args[1], ':') || strchr(args[2], ':')) {
+    //pinDist or diameter is a range
+    std::vector<double> pins, diameters;
+    if (!parseRange(args[1], pins) || !parseRange(args[2], diameters)) {
+      std::cerr << "Ranges are written min:max:step" << std::endl;
       return 0;
     }
-    /**
-     * Try all 81 (l/s/r)*(t/s/b)*(l/s/r)*(t/s/b) possibilities,
-     * For a possibility to be physically possible:
-     *  (1) the labyrinth must be empty on both top and bottom
-     *  (2) the pins must be separated by the correct distance
-     *  (3) the ring must not wipe through something other than InputSpace. TODO
-     */
-#define TRY_POS(nextTopPos, nextBottomPos)\
-    if ((nextTopPos) != Laby::InvalidPos && (nextBottomPos) != Laby::InvalidPos && laby.validate((nextTopPos), (nextBottomPos), ring) && !beenThereBefore((nextTopPos), (nextBottomPos), current.time + 1)) {\
-      queue.push(Node((nextTopPos), (nextBottomPos), current.time + 1));\
-      beenThereBefore.set((nextTopPos), (nextBottomPos), current.time + 1, current.topPos, current.bottomPos);\
+    if (visited != "dense" || bidirectional || aStar) {
+      std::cerr << "Ranges only work with --visited=dense and without --bidirectional or --astar" << std::endl;
+      return 0;
     }
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.up(current.bottomPos))
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.left(current.bottomPos))
-    TRY_POS(laby.up(laby.left(current.topPos)), current.bottomPos)
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.right(current.bottomPos))
-
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.down(current.bottomPos))
-    TRY_POS(laby.up(laby.left(current.topPos)), laby.down(laby.right(current.bottomPos)))
-
-
-    TRY_POS(laby.up(current.topPos), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.up(current.topPos), laby.up(current.bottomPos))
-    TRY_POS(laby.up(current.topPos), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.up(current.topPos), laby.left(current.bottomPos))
-    TRY_POS(laby.up(current.topPos), current.bottomPos)
-    TRY_POS(laby.up(current.topPos), laby.right(current.bottomPos))
-
-    TRY_POS(laby.up(current.topPos), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.up(current.topPos), laby.down(current.bottomPos))
-    TRY_POS(laby.up(current.topPos), laby.down(laby.right(current.bottomPos)))
-
-
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.up(current.bottomPos))
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.left(current.bottomPos))
-    TRY_POS(laby.up(laby.right(current.topPos)), current.bottomPos)
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.right(current.bottomPos))
-
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.down(current.bottomPos))
-    TRY_POS(laby.up(laby.right(current.topPos)), laby.down(laby.right(current.bottomPos)))
-
-
-
-    TRY_POS(laby.left(current.topPos), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.left(current.topPos), laby.up(current.bottomPos))
-    TRY_POS(laby.left(current.topPos), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.left(current.topPos), laby.left(current.bottomPos))
-    TRY_POS(laby.left(current.topPos), current.bottomPos)
-    TRY_POS(laby.left(current.topPos), laby.right(current.bottomPos))
-
-    TRY_POS(laby.left(current.topPos), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.left(current.topPos), laby.down(current.bottomPos))
-    TRY_POS(laby.left(current.topPos), laby.down(laby.right(current.bottomPos)))
-
-
-    TRY_POS(current.topPos, laby.up(laby.left(current.bottomPos)))
-    TRY_POS(current.topPos, laby.up(current.bottomPos))
-    TRY_POS(current.topPos, laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(current.topPos, laby.left(current.bottomPos))
-    //TRY_POS(current.topPos, current.bottomPos)
-    TRY_POS(current.topPos, laby.right(current.bottomPos))
-
-    TRY_POS(current.topPos, laby.down(laby.left(current.bottomPos)))
-    TRY_POS(current.topPos, laby.down(current.bottomPos))
-    TRY_POS(current.topPos, laby.down(laby.right(current.bottomPos)))
-
-
-    TRY_POS(laby.right(current.topPos), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.right(current.topPos), laby.up(current.bottomPos));
-    TRY_POS(laby.right(current.topPos), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.right(current.topPos), laby.left(current.bottomPos))
-    TRY_POS(laby.right(current.topPos), current.bottomPos)
-    TRY_POS(laby.right(current.topPos), laby.right(current.bottomPos))
-
-    TRY_POS(laby.right(current.topPos), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.right(current.topPos), laby.down(current.bottomPos))
-    TRY_POS(laby.right(current.topPos), laby.down(laby.right(current.bottomPos)))
-
-
-
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.up(current.bottomPos))
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.left(current.bottomPos))
-    TRY_POS(laby.down(laby.left(current.topPos)), current.bottomPos)
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.right(current.bottomPos))
-
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.down(current.bottomPos))
-    TRY_POS(laby.down(laby.left(current.topPos)), laby.down(laby.right(current.bottomPos)))
-
-
-    TRY_POS(laby.down(current.topPos), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.down(current.topPos), laby.up(current.bottomPos))
-    TRY_POS(laby.down(current.topPos), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.down(current.topPos), laby.left(current.bottomPos))
-    TRY_POS(laby.down(current.topPos), current.bottomPos)
-    TRY_POS(laby.down(current.topPos), laby.right(current.bottomPos))
-
-    TRY_POS(laby.down(current.topPos), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.down(current.topPos), laby.down(current.bottomPos))
-    TRY_POS(laby.down(current.topPos), laby.down(laby.right(current.bottomPos)))
-
-
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.up(laby.left(current.bottomPos)))
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.up(current.bottomPos))
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.up(laby.right(current.bottomPos)))
-
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.left(current.bottomPos))
-    TRY_POS(laby.down(laby.right(current.topPos)), current.bottomPos)
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.right(current.bottomPos))
-
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.down(laby.left(current.bottomPos)))
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.down(current.bottomPos))
-    TRY_POS(laby.down(laby.right(current.topPos)), laby.down(laby.right(current.bottomPos)))
-
+    WorkerPool pool(std::max(nThreads, 1u));
+    runScan(laby, pins, diameters, sweep, prune, pool);
+    return 0;
+  }
+  if (!drawFile.empty() && laby.getWidth() > 0 && laby.getHeight() > (unsigned)pinDist) {
+    laby.draw(drawFile.c_str(), laby.coordsToPos(0, 0), laby.coordsToPos(0, (unsigned)pinDist));
   }
 
-  std::cerr << "Path not found" << std::endl;
+  Ring ring(pinDist, diameter, sqrt(2.0)/2.0);
+  if (prune) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    size_t topCells = laby.openCells(true), bottomCells = laby.openCells(false);
+    bool connected = pruneLaby(laby, ring);
+    if (!quiet) {
+      std::cerr << "pruned: top " << topCells << " -> " << laby.openCells(true) << " cells, bottom " << bottomCells << " -> "
+                << laby.openCells(false) << " cells in " << std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count() << "s" << std::endl;
+    }
+    if (!connected) {
+      std::cerr << "Path not found (a pin cannot reach an exit from its start)" << std::endl;
+      return 0;
+    }
+  }
+  StatsLog statsLog;
+  if (!statsFile.empty()) {
+    if (!statsLog.open(statsFile, statsInterval)) {
+      return 0;
+    }
+    solver.setStats(true);
+  }
+  if (!quiet || !statsFile.empty()) {
+    solver.setProgress([&](const char* name, unsigned time, size_t nodes) {
+      if (!quiet) {
+        std::cerr << name << ": " << time << (strcmp(name, "estimate") == 0 ? " expanded: " : (strcmp(name, "level") == 0 ? " steps: " : " nodes: ")) << nodes << std::endl;
+      }
+      if (!statsFile.empty()) {
+        statsLog.write(name, time, nodes, solver.getStats(), false);
+      }
+      return true;
+    });
+  }
+  std::vector<PathStep> path;
+  LabySolver::Result result = solver.solve(laby, ring, path);
+  if (!statsFile.empty()) {
+    statsLog.write("done", path.empty() ? 0 : path.size() - 1, 0, solver.getStats(), true);
+  }
+  if (result == LabySolver::InvalidStart) {
+    std::cerr << "Start position is not compatible with the ring" << std::endl;
+    return 0;
+  }
+  if (result == LabySolver::BadCheckpoint) {
+    std::cerr << "Cannot resume from '" << checkpoint << "'" << std::endl;
+    return 0;
+  }
+  bool found = result == LabySolver::Found;
+  if (found) {
+    std::cerr << "Found path in " << path.size() - 1 << " steps";
+    if (aStar) {
+      std::cerr << ", expanded " << solver.getExpanded() << " nodes";
+    }
+    std::cerr << std::endl;
+    if (saveFile.empty()) {
+      printPath(std::cout, laby, ring, path);
+    } else {
+      PathWriter::write(saveFile.c_str(), laby.getWidth(), laby.getHeight(), ring, path, runLength, &std::cerr);
+    }
+  }
+  if (!found) {
+    std::cerr << "Path not found" << std::endl;
+  }
   return 0;
 }
-
-
-
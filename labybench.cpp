@@ -0,0 +1,414 @@
+/**
+ * Copyright (C) 2012 Clement Courbet
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <vector>
+#include <random>
+#include <chrono>
+#include <math.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/wait.h>
+
+#include "labysolver.hpp"
+
+/**
+ * Benchmarks of the solver: the building blocks on their own, then whole solves.
+ * The results are printed as a JSON object of metric -> value. Metrics that end in
+ * '_per_second' are better when higher, the others (seconds, bytes) when lower.
+ * With --baseline, each metric is compared to the one in a JSON file written by
+ * --output, and the ones that got worse by more than 10% are marked. Times vary from run
+ * to run by more than that, so only the node counts and the peak memory of the solves,
+ * which do not, are regressions: the exit status is then 2. Slower times are only reported.
+ */
+
+typedef std::vector<std::pair<std::string, double> > Results;
+
+double secondsSince(std::chrono::steady_clock::time_point begin) {
+  return std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+}
+
+//calls f(), which does 'ops' operations, until it has run for 0.1s, 5 times, and returns the best operations per second
+template <class F>
+double opsPerSecond(size_t ops, F f) {
+  double best = 0;
+  for (unsigned sample = 0; sample < 5; ++sample) {
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    size_t done = 0;
+    double seconds;
+    do {
+      f();
+      done += ops;
+      seconds = secondsSince(begin);
+    } while (seconds < 0.1);
+    best = std::max(best, done / seconds);
+  }
+  return best;
+}
+
+//keeps the compiler from removing the benchmarked code
+volatile size_t sink;
+
+/**
+ * Laby::validate, Ring::validatePinPos, move expansion and the visited stores,
+ * on random positions where the pins are at the ring distance.
+ */
+void benchSolver(const Laby& laby, Ring& ring, Results& results) {
+  std::mt19937_64 random(42);
+  StateEncoding states(laby, ring);
+  const RingOffsets& offsets = states.getOffsets();
+
+  //pin positions at the ring distance, and the states of the valid ones
+  std::vector<std::pair<size_t, size_t> > pins;
+  std::vector<size_t> valid;
+  for (unsigned tries = 0; tries < (1u << 24) && (pins.size() < (1u << 16) || valid.size() < (1u << 16)); ++tries) {
+    unsigned x = random() % laby.getWidth(), y = random() % laby.getHeight();
+    unsigned offset = random() % offsets.size();
+    int xb = x + offsets.dx(offset), yb = y + offsets.dy(offset);
+    if (xb < 0 || xb >= (int)laby.getWidth() || yb < 0 || yb >= (int)laby.getHeight()) {
+      continue;
+    }
+    size_t topPos = laby.coordsToPos(x, y), bottomPos = laby.coordsToPos(xb, yb);
+    if (pins.size() < (1u << 16)) {
+      pins.push_back(std::make_pair(topPos, bottomPos));
+    }
+    if (valid.size() < (1u << 16) && laby.validate(topPos, bottomPos, ring)) {
+      valid.push_back(states.stateOf(topPos, bottomPos));
+    }
+  }
+
+  results.push_back(std::make_pair("validate_per_second", opsPerSecond(pins.size(), [&]() {
+    size_t n = 0;
+    for (size_t i = 0; i < pins.size(); ++i) {
+      n += laby.validate(pins[i].first, pins[i].second, ring);
+    }
+    sink = n;
+  })));
+  results.push_back(std::make_pair("validate_pin_pos_per_second", opsPerSecond(pins.size(), [&]() {
+    size_t n = 0;
+    for (size_t i = 0; i < pins.size(); ++i) {
+      unsigned xt, yt, xb, yb;
+      laby.posToCoords(pins[i].first, xt, yt);
+      laby.posToCoords(pins[i].second, xb, yb);
+      n += ring.validatePinPos(xt, yt, xb, yb, laby);
+    }
+    sink = n;
+  })));
+  results.push_back(std::make_pair("expand_81_moves_per_second", opsPerSecond(valid.size(), [&]() {
+    size_t n = 0;
+    for (size_t i = 0; i < valid.size(); ++i) {
+      states.forEachValidMove(valid[i], [&](size_t next, size_t, size_t, unsigned char) {
+        n += next;
+      });
+    }
+    sink = n;
+  })));
+
+  //distinct random states, in random order
+  std::vector<size_t> ids(1 << 20);
+  for (size_t i = 0; i < ids.size(); ++i) {
+    ids[i] = random() % states.size();
+  }
+  std::sort(ids.begin(), ids.end());
+  ids.erase(std::unique(ids.begin(), ids.end()), ids.end());
+  std::shuffle(ids.begin(), ids.end(), random);
+
+  VisitedPositionsArray dense(states);
+  VisitedPositionsHashMap hash(states);
+  results.push_back(std::make_pair("dense_insert_per_second", opsPerSecond(ids.size(), [&]() {
+    dense.reset(states);
+    for (size_t i = 0; i < ids.size(); ++i) {
+      dense.set(ids[i], 1, 0, StateEncoding::NoMove);
+    }
+  })));
+  results.push_back(std::make_pair("dense_lookup_per_second", opsPerSecond(ids.size(), [&]() {
+    size_t n = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      n += dense(ids[i] ^ (i & 1), 1);
+    }
+    sink = n;
+  })));
+  results.push_back(std::make_pair("hash_insert_per_second", opsPerSecond(ids.size(), [&]() {
+    hash.reset(states);
+    for (size_t i = 0; i < ids.size(); ++i) {
+      hash.set(ids[i], 1, 0, StateEncoding::NoMove);
+    }
+  })));
+  results.push_back(std::make_pair("hash_lookup_per_second", opsPerSecond(ids.size(), [&]() {
+    size_t n = 0;
+    for (size_t i = 0; i < ids.size(); ++i) {
+      n += hash(ids[i] ^ (i & 1), 1);
+    }
+    sink = n;
+  })));
+}
+
+/**
+ * PnmReader on the labyrinth image written in each of the P1 to P6 formats,
+ * in pixels per second.
+ */
+bool benchPnm(const char* input, const std::string& tmpDir, Results& results) {
+  unsigned w, h;
+  std::vector<unsigned char> rgb;
+  if (!PnmReader::read(input, w, h, rgb, &std::cerr)) {
+    return false;
+  }
+  for (unsigned format = 1; format <= 6; ++format) {
+    std::ostringstream filename;
+    filename << tmpDir << "/labybench" << getpid() << ".p" << format;
+    unsigned channels = format == 3 || format == 6 ? 3 : 1;
+    auto sample = [&](size_t i, unsigned c) {
+      return channels == 3 ? rgb[3 * i + c] : rgb[3 * i];
+    };
+    if (format >= 4) {
+      PnmWriter::Format binary = format == 4 ? PnmWriter::PBM : (format == 5 ? PnmWriter::PGM : PnmWriter::PPM);
+      PnmWriter::write(filename.str().c_str(), w, h, binary, [&](unsigned y, unsigned char* row) {
+        for (size_t x = 0; x < w; ++x) {
+          for (unsigned c = 0; c < channels; ++c) {
+            row[channels * x + c] = sample((size_t)y * w + x, c);
+          }
+        }
+      }, &std::cerr);
+    } else {
+      std::ofstream ofs(filename.str().c_str());
+      ofs << "P" << format << "\n" << w << " " << h << "\n" << (format == 1 ? "" : "255\n");
+      for (size_t i = 0; i < (size_t)w * h; ++i) {
+        for (unsigned c = 0; c < channels; ++c) {
+          ofs << (format == 1 ? (sample(i, c) > 128 ? 0 : 1) : sample(i, c)) << ((i + 1) % w == 0 && c + 1 == channels ? '\n' : ' ');
+        }
+      }
+    }
+    std::ostringstream name;
+    name << "read_p" << format << "_pixels_per_second";
+    results.push_back(std::make_pair(name.str(), opsPerSecond((size_t)w * h, [&]() {
+      size_t n = 0;
+      PnmReader::readRows(filename.str().c_str(), [&](unsigned, unsigned) {
+        return true;
+      }, [&](unsigned, const unsigned char* row) {
+        n += row[0];
+      }, &std::cerr);
+      sink = n;
+    })));
+    unlink(filename.str().c_str());
+  }
+  return true;
+}
+
+/**
+ * Solves in a child process, so that the peak memory is the one of the solve.
+ * Adds <name>_seconds, <name>_nodes, <name>_nodes_per_second and <name>_peak_rss_bytes.
+ */
+void benchSolve(const std::string& name, const char* input, double pinDist, double diameter, bool switchTopBottom,
+                LabySolver::Method method, LabySolver::Store store, Results& results) {
+  int fds[2];
+  if (pipe(fds) != 0) {
+    return;
+  }
+  pid_t pid = fork();
+  if (pid == 0) {
+    close(fds[0]);
+    std::chrono::steady_clock::time_point begin = std::chrono::steady_clock::now();
+    Laby laby(input, switchTopBottom);
+    Ring ring(pinDist, diameter, sqrt(2.0)/2.0);
+    LabySolver solver;
+    solver.setMethod(method);
+    solver.setStore(store);
+    //each state of a layer is expanded once
+    size_t nodes = 0;
+    solver.setProgress([&](const char*, unsigned, size_t layerSize) {
+      nodes += layerSize;
+      return true;
+    });
+    std::vector<PathStep> path;
+    LabySolver::Result result = laby.getWidth() > 0 ? solver.solve(laby, ring, path) : LabySolver::InvalidStart;
+    if (method == LabySolver::AStar) {
+      nodes = solver.getExpanded();
+    }
+    char line[128];
+    int length = snprintf(line, sizeof(line), "%d %g %zu %zu\n", (int)result, secondsSince(begin), nodes, path.size());
+    _exit(write(fds[1], line, length) == length ? 0 : 1);
+  }
+  close(fds[1]);
+  if (pid < 0) {
+    close(fds[0]);
+    return;
+  }
+  char line[128] = {0};
+  ssize_t length = read(fds[0], line, sizeof(line) - 1);
+  close(fds[0]);
+  int status;
+  struct rusage usage;
+  wait4(pid, &status, 0, &usage);
+  int result;
+  double seconds;
+  size_t nodes, steps;
+  if (length <= 0 || sscanf(line, "%d %lg %zu %zu", &result, &seconds, &nodes, &steps) != 4) {
+    std::cerr << name << ": the solve did not finish" << std::endl;
+    return;
+  }
+  std::cerr << name << ": " << (result == LabySolver::Found ? "found " : "no path ") << (steps > 0 ? steps - 1 : 0) << " steps" << std::endl;
+  results.push_back(std::make_pair(name + "_seconds", seconds));
+  results.push_back(std::make_pair(name + "_nodes", (double)nodes));
+  results.push_back(std::make_pair(name + "_nodes_per_second", nodes / seconds));
+  results.push_back(std::make_pair(name + "_peak_rss_bytes", usage.ru_maxrss * 1024.0));
+}
+
+//the labyrinth with each cell made into factor * factor cells, for the same ring scaled by factor
+bool writeScaled(const char* input, unsigned factor, const std::string& output) {
+  unsigned w, h;
+  std::vector<unsigned char> rgb;
+  if (!PnmReader::read(input, w, h, rgb, &std::cerr)) {
+    return false;
+  }
+  return PnmWriter::write(output.c_str(), w * factor, h * factor, PnmWriter::PPM, [&](unsigned y, unsigned char* row) {
+    for (size_t x = 0; x < (size_t)w * factor; ++x) {
+      memcpy(row + 3 * x, &rgb[3 * ((size_t)(y / factor) * w + x / factor)], 3);
+    }
+  }, &std::cerr);
+}
+
+void writeResults(std::ostream& os, const Results& results) {
+  os << "{\n";
+  for (size_t i = 0; i < results.size(); ++i) {
+    os << "  \"" << results[i].first << "\": " << results[i].second << (i + 1 < results.size() ? ",\n" : "\n");
+  }
+  os << "}\n";
+}
+
+//reads the "name": value lines written by writeResults
+bool readResults(const char* filename, Results& results) {
+  std::ifstream ifs(filename);
+  if (!ifs.good()) {
+    std::cerr << "Cannot open file '" << filename << "' for reading." << std::endl;
+    return false;
+  }
+  std::string line;
+  while (std::getline(ifs, line)) {
+    size_t begin = line.find('"'), end = line.find("\":");
+    if (begin != std::string::npos && end != std::string::npos && end > begin) {
+      results.push_back(std::make_pair(line.substr(begin + 1, end - begin - 1), atof(line.c_str() + end + 2)));
+    }
+  }
+  return true;
+}
+
+//whether a metric is the same from run to run on the same code: the node counts and the peak memory of the solves
+bool isStable(const std::string& name) {
+  return (name.size() > 6 && name.compare(name.size() - 6, 6, "_nodes") == 0)
+    || (name.size() > 15 && name.compare(name.size() - 15, 15, "_peak_rss_bytes") == 0);
+}
+
+//prints each metric next to its baseline, and marks the ones more than 10% worse; returns the number of the stable ones
+unsigned compare(const Results& results, const Results& baseline) {
+  unsigned regressions = 0;
+  for (size_t i = 0; i < results.size(); ++i) {
+    const std::string& name = results[i].first;
+    std::cerr << name << ": " << results[i].second;
+    for (size_t j = 0; j < baseline.size(); ++j) {
+      if (baseline[j].first == name && baseline[j].second > 0) {
+        bool higherIsBetter = name.size() > 11 && name.compare(name.size() - 11, 11, "_per_second") == 0;
+        double ratio = results[i].second / baseline[j].second;
+        bool worse = higherIsBetter ? ratio < 1 / 1.1 : ratio > 1.1;
+        regressions += worse && isStable(name);
+        std::cerr << " (baseline " << baseline[j].second << ", x" << ratio << ")" << (!worse ? "" : isStable(name) ? " REGRESSION" : " slower");
+      }
+    }
+    std::cerr << std::endl;
+  }
+  return regressions;
+}
+
+int main(int argc, char **argv) {
+  std::string input = "laby.ppm";
+  std::string baselineFile;
+  std::string outputFile;
+  std::string tmpDir = "/tmp";
+  bool large = true;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 11, "--baseline=") == 0) {
+      baselineFile = arg.substr(11);
+    } else if (arg.compare(0, 9, "--output=") == 0) {
+      outputFile = arg.substr(9);
+    } else if (arg.compare(0, 9, "--tmpdir=") == 0) {
+      tmpDir = arg.substr(9);
+    } else if (arg == "--small") {
+      large = false;
+    } else if (arg[0] != '-') {
+      input = arg;
+    } else {
+      std::cerr << "Usage: labybench [--baseline=baseline.json] [--output=results.json] [--tmpdir=dir] [--small] [input.ppm]" << std::endl;
+      std::cerr << "       input.ppm defaults to laby.ppm, solved with pinDist 52.5, diameter 240 and switch" << std::endl;
+      return 1;
+    }
+  }
+
+  Results results;
+  Laby laby(input.c_str(), true);
+  if (laby.getWidth() == 0) {
+    return 1;
+  }
+  Ring ring(52.5, 240, sqrt(2.0)/2.0);
+  benchSolver(laby, ring, results);
+  if (!benchPnm(input.c_str(), tmpDir, results)) {
+    return 1;
+  }
+
+  benchSolve("solve_bfs", input.c_str(), 52.5, 240, true, LabySolver::BreadthFirst, LabySolver::Dense, results);
+  benchSolve("solve_bfs_hash", input.c_str(), 52.5, 240, true, LabySolver::BreadthFirst, LabySolver::Hash, results);
+  benchSolve("solve_astar", input.c_str(), 52.5, 240, true, LabySolver::AStar, LabySolver::Hash, results);
+  if (large) {
+    //the same labyrinth at twice the resolution: 8 times as many states
+    std::ostringstream scaled;
+    scaled << tmpDir << "/labybench" << getpid() << ".x2.ppm";
+    if (writeScaled(input.c_str(), 2, scaled.str())) {
+      benchSolve("solve_bfs_x2", scaled.str().c_str(), 105, 480, true, LabySolver::BreadthFirst, LabySolver::Dense, results);
+    }
+    unlink(scaled.str().c_str());
+  }
+
+  if (outputFile.empty()) {
+    writeResults(std::cout, results);
+  } else {
+    std::ofstream ofs(outputFile.c_str());
+    writeResults(ofs, results);
+    if (!ofs.good()) {
+      std::cerr << "Cannot write '" << outputFile << "'" << std::endl;
+      return 1;
+    }
+  }
+  if (!baselineFile.empty()) {
+    Results baseline;
+    if (!readResults(baselineFile.c_str(), baseline)) {
+      return 1;
+    }
+    unsigned regressions = compare(results, baseline);
+    std::cerr << regressions << " regression(s) of more than 10% in node counts or peak memory against " << baselineFile << std::endl;
+    if (regressions > 0) {
+      return 2;
+    }
+  }
+  return 0;
+}
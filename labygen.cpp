@@ -0,0 +1,241 @@
+/**
+ * Copyright (C) 2012 Clement Courbet
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <random>
+#include <algorithm>
+#include <math.h>
+#include <stdlib.h>
+
+#include "pgm.hpp"
+
+/**
+ * A perfect maze generated one row at a time with Eller's algorithm, so that only
+ * the current row is in memory. For each row, right[j] tells if cell j is open to
+ * cell j + 1, and down[j] if it is open to cell j of the next row.
+ */
+class EllerMaze {
+  public:
+    EllerMaze(unsigned nColumns, unsigned nRows, uint64_t seed)
+     : _nColumns(nColumns), _nRows(nRows), _row(0), _random(seed), _set(nColumns), _parent(2 * nColumns),
+       _lastOfSet(2 * nColumns), _hasDown(2 * nColumns), right(nColumns, false), down(nColumns, false) {
+      for (unsigned j = 0; j < _nColumns; ++j) {
+        _set[j] = j;
+      }
+      makeRow();
+    }
+
+    //moves to the next row
+    void next() {
+      //the cells that go down keep their set, the others get a new one
+      unsigned nextSet = _nColumns;
+      for (unsigned j = 0; j < _nColumns; ++j) {
+        _set[j] = down[j] ? _set[j] : nextSet++;
+      }
+      //number the sets from 0 again
+      std::vector<unsigned>& number = _lastOfSet;
+      std::fill(number.begin(), number.end(), NoSet);
+      unsigned nSets = 0;
+      for (unsigned j = 0; j < _nColumns; ++j) {
+        if (number[_set[j]] == NoSet) {
+          number[_set[j]] = nSets++;
+        }
+        _set[j] = number[_set[j]];
+      }
+      ++_row;
+      makeRow();
+    }
+
+  private:
+    static const unsigned NoSet = 0xffffffff;
+
+    unsigned find(unsigned set) {
+      while (_parent[set] != set) {
+        set = _parent[set] = _parent[_parent[set]];
+      }
+      return set;
+    }
+
+    void makeRow() {
+      bool last = _row + 1 >= _nRows;
+      for (unsigned s = 0; s < _parent.size(); ++s) {
+        _parent[s] = s;
+      }
+      //join neighbours of different sets at random, or all of them on the last row
+      for (unsigned j = 0; j + 1 < _nColumns; ++j) {
+        unsigned a = find(_set[j]), b = find(_set[j + 1]);
+        right[j] = a != b && (last || (_random() & 1));
+        if (right[j]) {
+          _parent[b] = a;
+        }
+      }
+      right[_nColumns - 1] = false;
+      for (unsigned j = 0; j < _nColumns; ++j) {
+        _set[j] = find(_set[j]);
+      }
+      if (last) {
+        std::fill(down.begin(), down.end(), false);
+        return;
+      }
+      //go down at random, and at least once per set
+      std::fill(_hasDown.begin(), _hasDown.end(), false);
+      for (unsigned j = 0; j < _nColumns; ++j) {
+        down[j] = (_random() & 1) != 0;
+        _hasDown[_set[j]] = _hasDown[_set[j]] || down[j];
+        _lastOfSet[_set[j]] = j;
+      }
+      for (unsigned j = 0; j < _nColumns; ++j) {
+        if (!_hasDown[_set[j]]) {
+          down[_lastOfSet[_set[j]]] = true;
+          _hasDown[_set[j]] = true;
+        }
+      }
+    }
+
+    unsigned _nColumns;
+    unsigned _nRows;
+    unsigned _row;
+    std::mt19937_64 _random;
+    std::vector<unsigned> _set;
+    std::vector<unsigned> _parent;
+    std::vector<unsigned> _lastOfSet;
+    std::vector<bool> _hasDown;
+
+  public:
+    std::vector<bool> right;
+    std::vector<bool> down;
+};
+
+const unsigned EllerMaze::NoSet;
+
+/**
+ * Draws the mazes of one layer: cells of 'corridor' pixels separated by 'wall' pixels.
+ */
+class MazeLayer {
+  public:
+    MazeLayer(unsigned width, unsigned height, unsigned corridor, unsigned wall, uint64_t seed)
+     : _corridor(corridor), _period(corridor + wall), _nColumns(std::max((width + wall) / _period, 1u)),
+       _nRows(std::max((height + wall) / _period, 1u)), _maze(_nColumns, _nRows, seed) {
+    }
+
+    //open pixels of row y, called for y = 0, 1, ...
+    void row(unsigned y, std::vector<bool>& open) {
+      unsigned mazeRow = y / _period;
+      if (mazeRow > 0 && y % _period == 0 && mazeRow < _nRows) {
+        _maze.next();
+      }
+      bool corridorRow = y % _period < _corridor;
+      for (unsigned x = 0; x < open.size(); ++x) {
+        unsigned j = x / _period;
+        if (mazeRow >= _nRows || j >= _nColumns) {
+          open[x] = false;
+        } else if (x % _period < _corridor) {
+          open[x] = corridorRow || _maze.down[j];
+        } else {
+          open[x] = corridorRow && _maze.right[j];
+        }
+      }
+    }
+
+  private:
+    unsigned _corridor;
+    unsigned _period;
+    unsigned _nColumns;
+    unsigned _nRows;
+    EllerMaze _maze;
+};
+
+int main(int argc, char **argv) {
+  std::vector<const char*> args;
+  uint64_t seed = 1;
+  unsigned corridor = 3;
+  unsigned wall = 2;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 7, "--seed=") == 0) {
+      seed = strtoull(arg.c_str() + 7, NULL, 10);
+    } else if (arg.compare(0, 11, "--corridor=") == 0) {
+      corridor = std::max(atoi(arg.c_str() + 11), 1);
+    } else if (arg.compare(0, 7, "--wall=") == 0) {
+      wall = std::max(atoi(arg.c_str() + 7), 1);
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() < 5) {
+    std::cerr << "Usage: labygen [--seed=n] [--corridor=pixels] [--wall=pixels] <output.ppm> <width> <height> <pinDist> <diameter>" << std::endl;
+    return 0;
+  }
+  const char* output = args[0];
+  unsigned width = atoi(args[1]);
+  unsigned height = atoi(args[2]);
+  double pinDist = atof(args[3]);
+  double diameter = atof(args[4]);
+
+  /*
+   * The route: both pins go right from the start (top pin at (0, 0), bottom pin pinDist below)
+   * to exits on the right edge, moving up and down together, so that the pin offset does not
+   * change. The ring is then 'diameter' above the bottom pin, which is above the labyrinth
+   * as long as the top pin stays in the first 'band' rows.
+   */
+  unsigned bottomDy = (unsigned)pinDist;
+  double ringAbove = bottomDy * diameter / pinDist - bottomDy; //above the top pin
+  if (width < 2 || pinDist < 1 || height <= bottomDy || ringAbove < 1.5) {
+    std::cerr << "The labyrinth must be taller than pinDist, and the ring larger than pinDist" << std::endl;
+    return 0;
+  }
+  unsigned band = std::min((unsigned)(ringAbove - 0.5), height - bottomDy);
+  std::mt19937_64 random(seed);
+  std::vector<unsigned> route(width);
+  route[0] = 0;
+  for (unsigned x = 1; x < width; ++x) {
+    route[x] = route[x - 1];
+    if (random() % 8 == 0) {
+      int step = (int)(random() % (band / 2 + 1)) - (int)(band / 4);
+      route[x] = std::min(std::max((int)route[x] + step, 0), (int)band - 1);
+    }
+  }
+  //the top pin goes through (x, y) if y is between the rows of the route in columns x - 1 and x
+  auto onRoute = [&](unsigned x, int y) {
+    unsigned from = route[x > 0 ? x - 1 : 0];
+    return y >= (int)std::min(from, route[x]) && y <= (int)std::max(from, route[x]);
+  };
+
+  MazeLayer top(width, height, corridor, wall, seed * 2 + 1);
+  MazeLayer bottom(width, height, corridor, wall, seed * 2 + 2);
+  std::vector<bool> topOpen(width), bottomOpen(width);
+  bool ok = PnmWriter::write(output, width, height, PnmWriter::PPM, [&](unsigned y, unsigned char* rgb) {
+    top.row(y, topOpen);
+    bottom.row(y, bottomOpen);
+    for (unsigned x = 0; x < width; ++x) {
+      bool topRoute = y < band && onRoute(x, y);
+      bool bottomRoute = y >= bottomDy && onRoute(x, (int)y - (int)bottomDy);
+      bool exit = x == width - 1 && (y == route[x] || y == route[x] + bottomDy);
+      rgb[3 * x] = topOpen[x] || topRoute ? 255 : 0;
+      rgb[3 * x + 1] = bottomOpen[x] || bottomRoute ? 255 : 0;
+      rgb[3 * x + 2] = exit ? 255 : 0;
+    }
+  }, &std::cerr);
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,79 @@
+/**
+ * Copyright (C) 2012 Clement Courbet
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <iostream>
+#include <string>
+#include <vector>
+#include <math.h>
+
+#include "labypath.hpp"
+
+/**
+ * Prints a binary path file (see PathHeader) in the text format of laby, for makepaths.py,
+ * or checks it against its labyrinth.
+ */
+int main(int argc, char **argv) {
+  std::vector<const char*> args;
+  std::string labyrinth;
+  bool switchTopBottom = false;
+  bool sweep = false;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 8, "--check=") == 0) {
+      labyrinth = arg.substr(8);
+    } else if (arg == "--switch") {
+      switchTopBottom = true;
+    } else if (arg == "--sweep") {
+      sweep = true;
+    } else {
+      args.push_back(argv[i]);
+    }
+  }
+  if (args.size() != 1) {
+    std::cerr << "Usage: labypath <path.lpath> > output.path" << std::endl;
+    std::cerr << "       labypath --check=<input.ppm> [--switch] [--sweep] <path.lpath>" << std::endl;
+    return 1;
+  }
+
+  PathHeader header;
+  std::vector<PathStep> path;
+  if (!readPath(args[0], header, path, &std::cerr)) {
+    return 1;
+  }
+  if (labyrinth.empty()) {
+    printPath(std::cout, header.width, header.height, header.diameter, path);
+    return 0;
+  }
+
+  Laby laby(labyrinth.c_str(), switchTopBottom);
+  if (laby.getWidth() != header.width || laby.getHeight() != header.height) {
+    std::cerr << "The path is for a " << header.width << "x" << header.height << " labyrinth" << std::endl;
+    return 1;
+  }
+  Ring ring(header.pinDist, header.diameter, header.tolerance);
+  StateEncoding states(laby, ring, sweep);
+  if (!checkPath(states, ring, path, &std::cerr)) {
+    return 1;
+  }
+  std::cerr << "Valid path in " << path.size() - 1 << " steps" << std::endl;
+  return 0;
+}
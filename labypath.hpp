@@ -0,0 +1,297 @@
+/**
+ * Copyright (C) 2012 Clement Courbet
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LABYPATH_HPP_
+#define LABYPATH_HPP_
+
+#include <fstream>
+#include <vector>
+#include <string.h>
+#include <stdint.h>
+
+#include "labysolver.hpp"
+
+/**
+ * Binary path files: a PathHeader, then the moves from the first step, a byte each:
+ * 27 * (dxTop + 1) + 9 * (dyTop + 1) + 3 * (dxBottom + 1) + (dyBottom + 1), the move
+ * codes of StateEncoding. With the RunLength flag, a byte 128 + n is followed by a move
+ * that is made n + 2 times in a row.
+ */
+struct PathHeader {
+  static const uint32_t RunLength = 1;
+
+  char magic[8];
+  uint32_t width;
+  uint32_t height;
+  double pinDist;
+  double diameter;
+  double tolerance;
+  uint32_t topX; //first step
+  uint32_t topY;
+  uint32_t bottomX;
+  uint32_t bottomY;
+  uint64_t nMoves;
+  uint32_t flags;
+  uint32_t reserved;
+};
+
+
+/**
+ * Writes a path file a move at a time, through a buffer.
+ */
+class PathWriter {
+  public:
+    PathWriter(): _runLength(false), _run(0), _runCode(0) {
+      memset(&_header, 0, sizeof(_header));
+    }
+
+    ~PathWriter() {
+      close();
+    }
+
+    bool open(const char* filename, unsigned width, unsigned height, const Ring& ring, const PathStep& first,
+              bool runLength, std::ostream* err = NULL) {
+      _ofs.open(filename, std::ofstream::out | std::ofstream::binary);
+      if (!_ofs.good()) {
+        if (err) {
+          *err << "Cannot open file '" << filename << "' for writing." << std::endl;
+        }
+        return false;
+      }
+      memset(&_header, 0, sizeof(_header));
+      memcpy(_header.magic, "LABYPTH1", 8);
+      _header.width = width;
+      _header.height = height;
+      _header.pinDist = ring.getPinDistance();
+      _header.diameter = ring.getDiameter();
+      _header.tolerance = ring.getTolerance();
+      _header.topX = first.topX;
+      _header.topY = first.topY;
+      _header.bottomX = first.bottomX;
+      _header.bottomY = first.bottomY;
+      _header.flags = runLength ? PathHeader::RunLength : 0;
+      _runLength = runLength;
+      _run = 0;
+      _last = first;
+      _buffer.clear();
+      _buffer.reserve(bufSize);
+      //nMoves is written by close()
+      _ofs.write((const char*)&_header, sizeof(_header));
+      return true;
+    }
+
+    //the next step must be one move away from the last one
+    void writeStep(const PathStep& step) {
+      unsigned char code = 27 * (step.topX - _last.topX + 1) + 9 * (step.topY - _last.topY + 1)
+                         + 3 * (step.bottomX - _last.bottomX + 1) + (step.bottomY - _last.bottomY + 1);
+      assert(code < 81);
+      _last = step;
+      ++_header.nMoves;
+      if (!_runLength) {
+        put(code);
+      } else if (_run > 0 && code == _runCode) {
+        ++_run;
+      } else {
+        endRun();
+        _runCode = code;
+        _run = 1;
+      }
+    }
+
+    //returns false if writing failed
+    bool close(std::ostream* err = NULL) {
+      if (!_ofs.is_open()) {
+        return true;
+      }
+      endRun();
+      _ofs.write((const char*)_buffer.data(), _buffer.size());
+      _buffer.clear();
+      _ofs.seekp(0);
+      _ofs.write((const char*)&_header, sizeof(_header));
+      _ofs.close();
+      if (_ofs.fail()) {
+        if (err) {
+          *err << "PathWriter: cannot write the path." << std::endl;
+        }
+        return false;
+      }
+      return true;
+    }
+
+    static bool write(const char* filename, unsigned width, unsigned height, const Ring& ring, const std::vector<PathStep>& path,
+                      bool runLength, std::ostream* err = NULL) {
+      PathWriter writer;
+      if (path.empty() || !writer.open(filename, width, height, ring, path.front(), runLength, err)) {
+        return false;
+      }
+      for (size_t i = 1; i < path.size(); ++i) {
+        writer.writeStep(path[i]);
+      }
+      return writer.close(err);
+    }
+
+  private:
+    static const size_t bufSize = 1 << 20;
+
+    void put(unsigned char byte) {
+      _buffer.push_back(byte);
+      if (_buffer.size() >= bufSize) {
+        _ofs.write((const char*)_buffer.data(), _buffer.size());
+        _buffer.clear();
+      }
+    }
+
+    void endRun() {
+      while (_run >= 2) {
+        unsigned n = std::min(_run, 129u);
+        put(128 + n - 2);
+        put(_runCode);
+        _run -= n;
+      }
+      if (_run == 1) {
+        put(_runCode);
+      }
+      _run = 0;
+    }
+
+    std::ofstream _ofs;
+    PathHeader _header;
+    bool _runLength;
+    unsigned _run; //moves of the pending run
+    unsigned char _runCode;
+    PathStep _last;
+    std::vector<unsigned char> _buffer;
+
+    PathWriter(const PathWriter&);
+    void operator=(const PathWriter&);
+};
+
+
+/**
+ * Reads a path file into its header and steps.
+ */
+inline bool readPath(const char* filename, PathHeader& header, std::vector<PathStep>& path, std::ostream* err = NULL) {
+  MappedFile file;
+  if (!file.open(filename)) {
+    if (err) {
+      *err << "Cannot open file '" << filename << "' for reading." << std::endl;
+    }
+    return false;
+  }
+  const unsigned char* pos = file.begin() + sizeof(header);
+  if (file.end() - file.begin() < (long)sizeof(header) || memcmp(file.begin(), "LABYPTH1", 8) != 0) {
+    if (err) {
+      *err << "'" << filename << "' is not a path file." << std::endl;
+    }
+    return false;
+  }
+  memcpy(&header, file.begin(), sizeof(header));
+  //a byte holds at most one move, or 129 with RunLength (see PathWriter)
+  uint64_t maxMoves = (uint64_t)(file.end() - pos) * ((header.flags & PathHeader::RunLength) ? 129 : 1);
+  if (header.nMoves > maxMoves) {
+    if (err) {
+      *err << "'" << filename << "' is truncated or corrupt." << std::endl;
+    }
+    return false;
+  }
+  path.clear();
+  path.reserve(header.nMoves + 1);
+  PathStep step = {0, header.topX, header.topY, header.bottomX, header.bottomY};
+  path.push_back(step);
+  while (pos < file.end() && path.size() <= header.nMoves) {
+    unsigned repeat = 1;
+    if (*pos >= 128 && (header.flags & PathHeader::RunLength) && pos + 1 < file.end()) {
+      repeat = *pos++ - 128 + 2;
+    }
+    unsigned code = *pos++;
+    if (code >= 81) {
+      break;
+    }
+    for (unsigned k = 0; k < repeat; ++k) {
+      ++step.time;
+      step.topX += code / 27 - 1;
+      step.topY += (code / 9) % 3 - 1;
+      step.bottomX += (code / 3) % 3 - 1;
+      step.bottomY += code % 3 - 1;
+      path.push_back(step);
+    }
+  }
+  if (path.size() != header.nMoves + 1 || pos != file.end()) {
+    if (err) {
+      *err << "'" << filename << "' is truncated or corrupt." << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+/**
+ * Checks that the path starts at the start position (see startState), that each step is
+ * a valid move from the previous one (with the sweep check if it is on in 'states'),
+ * and that it ends with both pins on an exit. Explains the first problem on err.
+ */
+inline bool checkPath(const StateEncoding& states, const Ring& ring, const std::vector<PathStep>& path, std::ostream* err = NULL) {
+  const Laby& laby = states.getLaby();
+  size_t state = startState(states, ring);
+  if (path.empty() || state == StateEncoding::InvalidState) {
+    if (err) {
+      *err << "The start position is not compatible with the ring" << std::endl;
+    }
+    return false;
+  }
+  for (size_t i = 0; i < path.size(); ++i) {
+    const PathStep& step = path[i];
+    bool inside = step.topX < laby.getWidth() && step.topY < laby.getHeight()
+               && step.bottomX < laby.getWidth() && step.bottomY < laby.getHeight();
+    size_t next = inside ? states.stateOf(laby.coordsToPos(step.topX, step.topY), laby.coordsToPos(step.bottomX, step.bottomY))
+                         : StateEncoding::InvalidState;
+    bool valid = next != StateEncoding::InvalidState;
+    if (i == 0) {
+      valid = valid && next == state;
+    } else if (valid) {
+      bool reached = false;
+      states.forEachValidMove(state, [&](size_t to, size_t, size_t, unsigned char) {
+        reached = reached || to == next;
+      });
+      valid = reached;
+    }
+    if (!valid) {
+      if (err) {
+        *err << "Step " << i << " (" << step.topX << ", " << step.topY << ") (" << step.bottomX << ", " << step.bottomY
+             << ") " << (i == 0 ? "is not the start position" : "cannot be reached from the previous step") << std::endl;
+      }
+      return false;
+    }
+    state = next;
+  }
+  size_t topPos, bottomPos;
+  states.posOf(state, topPos, bottomPos);
+  if (laby.atTop(topPos) != Laby::Exit || laby.atBottom(bottomPos) != Laby::Exit) {
+    if (err) {
+      *err << "The last step is not on an exit" << std::endl;
+    }
+    return false;
+  }
+  return true;
+}
+
+#endif
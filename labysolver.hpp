@@ -0,0 +1,2639 @@
+/**
+ * Copyright (C) 2012 Clement Courbet
+ * Permission is hereby granted, free of charge, to any person
+ * obtaining a copy of this software and associated documentation
+ * files (the "Software"), to deal in the Software without restriction,
+ * including without limitation the rights to use, copy, modify,
+ * merge, publish, distribute, sublicense, and/or sell copies of
+ * the Software, and to permit persons to whom the Software is
+ * furnished to do so, subject to the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES
+ * OF MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef LABYSOLVER_HPP_
+#define LABYSOLVER_HPP_
+
+#include <queue>
+#include <vector>
+#include <iostream>
+#include <algorithm>
+#include <cassert>
+#include <limits>
+#include <math.h>
+
+#include <unordered_map>
+#include <memory>
+#include <string>
+#include <stdint.h>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include <sstream>
+#include <chrono>
+#include <errno.h>
+#include <string.h>
+#include <sys/wait.h>
+
+#include "pgm.hpp"
+
+/**
+ * The labyrinth solver, usable from other programs:
+ * build a Laby and a Ring, then call LabySolver::solve().
+ */
+
+struct Node {
+  Node (size_t state, unsigned time, unsigned estimate): state(state), time(time), estimate(estimate) {
+  }
+
+  size_t state;
+  unsigned time;
+  unsigned estimate; //lower bound of the time at which the exit can be reached through this node
+
+  //smallest estimate first, then the one that went the furthest
+  bool operator <(const Node& other) const {
+    return estimate > other.estimate || (estimate == other.estimate && time < other.time);
+  }
+
+  private:
+    Node();
+};
+
+class Ring {
+  public:
+    Ring(double interPinDistance, double diameter, double tolerance)
+     : _interPinDistance(interPinDistance), _diameter(diameter), _tolerance(tolerance) {
+    }
+
+    bool validPinDistance(double dx, double dy) const {
+      return dx*dx + dy*dy < (_interPinDistance + _tolerance) * (_interPinDistance + _tolerance) &&
+             dx*dx + dy*dy > (_interPinDistance - _tolerance) * (_interPinDistance - _tolerance);
+    }
+
+    template <class LabyT>
+    bool validatePinPos(double topX, double topY, double bottomX, double bottomY, const LabyT& laby) const {
+      if (validPinDistance(topX - bottomX, topY - bottomY)) {
+        //first check OK, now check that the ring does not intersect the laby.
+        double vx = (topX - bottomX) / _interPinDistance;
+        double vy = (topY - bottomY) / _interPinDistance;
+        int x = (unsigned)(bottomX + vx * _diameter + 0.5);
+        int y = (unsigned)(bottomY + vy * _diameter + 0.5);
+        if (x >= 0 && x < (int)laby.getWidth() && y >= 0 && y < (int)laby.getHeight()) {
+          return laby.atTop(laby.coordsToPos(x, y)) != LabyT::Path && laby.atBottom(laby.coordsToPos(x, y)) != LabyT::Path;
+        } else {
+          return true;
+        }
+      } else {
+        return false;
+      }
+    }
+
+    double getPinDistance() const {
+      return _interPinDistance;
+    }
+
+    double getDiameter() const {
+      return _diameter;
+    }
+
+    double getTolerance() const {
+      return _tolerance;
+    }
+
+  private:
+    double _interPinDistance;
+    double _diameter;
+    double _tolerance;
+
+    Ring();
+};
+
+/**
+ * The (dx,dy) offsets from the top pin to the bottom pin that the ring allows.
+ * Only a thin annulus of radius _interPinDistance +- _tolerance is valid, so
+ * the bottom pin position relative to the top pin can be stored as an index
+ * in this table.
+ */
+class RingOffsets {
+  public:
+    static const unsigned InvalidOffset = 0xffffffff;
+
+    //up to 64 consecutive cells of a row, relative to a pin: bit k is cell (dx + k, dy)
+    struct Span {
+      int dx;
+      int dy;
+      uint64_t mask;
+    };
+
+    RingOffsets(const Ring& ring) {
+      _radius = (int)ceil(ring.getPinDistance() + ring.getTolerance());
+      //a copy of the constant, which has no definition outside of the class to bind a reference to
+      _index.resize((2*_radius + 1) * (2*_radius + 1), (unsigned)InvalidOffset);
+      for (int dy = -_radius; dy <= _radius; ++dy) {
+        for (int dx = -_radius; dx <= _radius; ++dx) {
+          if (ring.validPinDistance(dx, dy)) {
+            _index[(2*_radius + 1) * (dy + _radius) + dx + _radius] = _dx.size();
+            _dx.push_back(dx);
+            _dy.push_back(dy);
+          }
+        }
+      }
+      setRing(ring);
+      _shifted.resize(25 * size());
+      for (unsigned i = 0; i < size(); ++i) {
+        for (int sy = -2; sy <= 2; ++sy) {
+          for (int sx = -2; sx <= 2; ++sx) {
+            _shifted[25 * i + shiftIndex(sx, sy)] = indexOf(_dx[i] + sx, _dy[i] + sy);
+          }
+        }
+      }
+    }
+
+    //the offsets of 'annulus', for another ring with the same offsets (see sameOffsets)
+    RingOffsets(const RingOffsets& annulus, const Ring& ring): RingOffsets(annulus) {
+      setRing(ring);
+    }
+
+    bool sameOffsets(const RingOffsets& other) const {
+      return _dx == other._dx && _dy == other._dy;
+    }
+
+    //index of a change of offset by (sx, sy), with sx and sy in [-2, 2]
+    static unsigned shiftIndex(int sx, int sy) {
+      return 5 * (sy + 2) + sx + 2;
+    }
+
+    unsigned size() const {
+      return _dx.size();
+    }
+
+    int dx(unsigned index) const {
+      return _dx[index];
+    }
+
+    int dy(unsigned index) const {
+      return _dy[index];
+    }
+
+    unsigned indexOf(int dx, int dy) const {
+      if (dx < -_radius || dx > _radius || dy < -_radius || dy > _radius) {
+        return InvalidOffset;
+      }
+      return _index[(2*_radius + 1) * (dy + _radius) + dx + _radius];
+    }
+
+    //the index of offset (dx(index), dy(index)) changed by shift, or InvalidOffset
+    unsigned shifted(unsigned index, unsigned shift) const {
+      return _shifted[25 * index + shift];
+    }
+
+    //where the ring touches the labyrinth, relative to the bottom pin
+    double ringX(unsigned index) const {
+      return _ringX[index];
+    }
+
+    double ringY(unsigned index) const {
+      return _ringY[index];
+    }
+
+    /**
+     * Appends to 'spans' the cells that the ring point goes through when the offset changes
+     * from 'from' to 'to' and the bottom pin moves by (dxBottom, dyBottom), relative to the
+     * bottom pin before the move. A cell is touched if the rounded position of a point
+     * of the segment between both ring points is that cell, like in Ring::validatePinPos.
+     * The reverse move touches the same cells.
+     */
+    void sweep(unsigned from, int dxBottom, int dyBottom, unsigned to, std::vector<Span>& spans) const {
+      //always compute the segment in the same direction, so that both moves get the same cells
+      if (from < to || (from == to && (dyBottom > 0 || (dyBottom == 0 && dxBottom >= 0)))) {
+        sweepSegment(_ringX[from], _ringY[from], dxBottom + _ringX[to], dyBottom + _ringY[to], 0, 0, spans);
+      } else {
+        sweepSegment(_ringX[to], _ringY[to], -dxBottom + _ringX[from], -dyBottom + _ringY[from], dxBottom, dyBottom, spans);
+      }
+    }
+
+  private:
+    void setRing(const Ring& ring) {
+      _ringX.resize(size());
+      _ringY.resize(size());
+      for (unsigned i = 0; i < size(); ++i) {
+        //same computation as Ring::validatePinPos
+        _ringX[i] = (double)-_dx[i] / ring.getPinDistance() * ring.getDiameter();
+        _ringY[i] = (double)-_dy[i] / ring.getPinDistance() * ring.getDiameter();
+      }
+    }
+
+    static int round(double v) {
+      return (int)floor(v + 0.5);
+    }
+
+    //cells of the segment from (x0, y0) to (x1, y1), moved by (shiftX, shiftY)
+    static void sweepSegment(double x0, double y0, double x1, double y1, int shiftX, int shiftY, std::vector<Span>& spans) {
+      for (int y = round(std::min(y0, y1)); y <= round(std::max(y0, y1)); ++y) {
+        //part of the segment in row y
+        double tBegin = 0.0;
+        double tEnd = 1.0;
+        if (y1 != y0) {
+          double ta = (y - 0.5 - y0) / (y1 - y0);
+          double tb = (y + 0.5 - y0) / (y1 - y0);
+          tBegin = std::max(tBegin, std::min(ta, tb));
+          tEnd = std::min(tEnd, std::max(ta, tb));
+        }
+        double xa = x0 + tBegin * (x1 - x0);
+        double xb = x0 + tEnd * (x1 - x0);
+        int xEnd = round(std::max(xa, xb)) + 1;
+        for (int x = round(std::min(xa, xb)); x < xEnd; x += 64) {
+          Span span;
+          span.dx = x + shiftX;
+          span.dy = y + shiftY;
+          span.mask = xEnd - x >= 64 ? ~(uint64_t)0 : ((uint64_t)1 << (xEnd - x)) - 1;
+          spans.push_back(span);
+        }
+      }
+    }
+
+    int _radius;
+    std::vector<int> _dx;
+    std::vector<int> _dy;
+    std::vector<double> _ringX;
+    std::vector<double> _ringY;
+    std::vector<unsigned> _index;
+    std::vector<unsigned> _shifted;
+
+    RingOffsets();
+};
+
+
+/**
+ * One bit per position of a labyrinth map.
+ * A guard word at the end allows reading 64 bits from any position.
+ */
+class BitPlane {
+  public:
+    void resize(size_t nBits) {
+      _words.assign(nBits / 64 + 2, 0);
+    }
+
+    bool get(size_t pos) const {
+      return (_words[pos >> 6] >> (pos & 63)) & 1;
+    }
+
+    void set(size_t pos, bool value) {
+      if (value) {
+        _words[pos >> 6] |= (uint64_t)1 << (pos & 63);
+      } else {
+        _words[pos >> 6] &= ~((uint64_t)1 << (pos & 63));
+      }
+    }
+
+    //the 64 bits from pos to pos + 63, pos in the lowest bit
+    uint64_t bitsAt(size_t pos) const {
+      unsigned shift = pos & 63;
+      if (shift == 0) {
+        return _words[pos >> 6];
+      }
+      return (_words[pos >> 6] >> shift) | (_words[(pos >> 6) + 1] << (64 - shift));
+    }
+
+    size_t sizeInBytes() const {
+      return _words.size() * sizeof(uint64_t);
+    }
+
+    //the bits as 64 bit words, bit k of word i is position 64*i + k
+    size_t wordCount() const {
+      return _words.size();
+    }
+
+    uint64_t word(size_t i) const {
+      return _words[i];
+    }
+
+    void setWord(size_t i, uint64_t value) {
+      _words[i] = value;
+    }
+
+    size_t count() const {
+      size_t n = 0;
+      for (size_t i = 0; i < _words.size(); ++i) {
+        n += __builtin_popcountll(_words[i]);
+      }
+      return n;
+    }
+
+  private:
+    std::vector<uint64_t> _words;
+};
+
+/**
+ * The labyrinth;
+ * Both maps are stored as bit planes with a one cell border of walls around them,
+ * so that the neighbours of a cell are at a fixed offset from it.
+ * Positions are indices in the bordered map, whose rows are padded to a
+ * multiple of 64 cells (getStride()), so rows start on a word boundary.
+ */
+struct Laby {
+public:
+  enum CellType { Path = 255, Wall = 0, Exit=254};
+  static const size_t InvalidPos = 0xffffffff;
+  static const unsigned UnreachableDistance = 0xffffffff;
+
+  Laby(unsigned width, unsigned height): _w(width), _h(height) {
+    allocate();
+    for (unsigned y = 0; y < _h; ++y) {
+      for (unsigned x = 0; x < _w; ++x) {
+        setCell(coordsToPos(x, y), true, true, false);
+      }
+    }
+  }
+
+  //create from pnm, decoding the rows straight into the maps
+  Laby(const char* filename, bool switchTopBottom): _w(0), _h(0) {
+    //red is top, green is bottom, or the other way round if switchTopBottom
+    // >128 is path, <128 is wall
+    // blue=255 is exit
+    unsigned top = switchTopBottom ? 1 : 0;
+    auto onSize = [&](unsigned w, unsigned h) {
+      _w = w;
+      _h = h;
+      allocate();
+      return true;
+    };
+    auto onRow = [&](unsigned y, const unsigned char* rgb) {
+      for (unsigned x = 0; x < _w; ++x) {
+        setCell(coordsToPos(x, y), rgb[3*x + top] > 128, rgb[3*x + 1 - top] > 128, rgb[3*x + 2] == 255);
+      }
+    };
+    if (!PnmReader::readRows(filename, onSize, onRow, &std::cerr)) {
+      _w = 0;
+      _h = 0;
+      allocate();
+    }
+  }
+
+  unsigned getWidth() const {
+    return _w;
+  }
+
+  unsigned getHeight() const {
+    return _h;
+  }
+
+  size_t getStride() const {
+    return _stride;
+  }
+
+  //number of positions, including the border and padding
+  size_t getCellCount() const {
+    return _stride * (_h + 2);
+  }
+
+  size_t sizeInBytes() const {
+    return _topOpen.sizeInBytes() + _bottomOpen.sizeInBytes() + _exit.sizeInBytes() + _ringBlock.sizeInBytes();
+  }
+
+  //the number of cells that are not walls in the map of a pin
+  size_t openCells(bool top) const {
+    return (top ? _topOpen : _bottomOpen).count();
+  }
+
+  CellType atTop(size_t pos) const {
+    return cellType(_bottomOpen, pos);
+  }
+
+  CellType atBottom(size_t pos) const {
+    return cellType(_topOpen, pos);
+  }
+
+  size_t coordsToPos(unsigned x, unsigned y) const {
+    assert(y < _h);
+    assert(x < _w);
+    return _stride*(y + 1) + x + 1;
+  }
+
+  void posToCoords(size_t pos, unsigned &x, unsigned &y) const {
+    assert(pos != InvalidPos);
+    x = pos % _stride - 1;
+    y = pos / _stride - 1;
+  }
+
+  //walls in the map of each pin
+  bool isTopWall(size_t pos) const {
+    return !_topOpen.get(pos);
+  }
+
+  bool isBottomWall(size_t pos) const {
+    return !_bottomOpen.get(pos);
+  }
+
+  //64 cells of the map of each pin from pos on, 1 where it is not a wall
+  uint64_t topOpenBits(size_t pos) const {
+    return _topOpen.bitsAt(pos);
+  }
+
+  uint64_t bottomOpenBits(size_t pos) const {
+    return _bottomOpen.bitsAt(pos);
+  }
+
+  bool isExit(size_t pos) const {
+    return _exit.get(pos);
+  }
+
+  //whether the ring cannot be on that cell: it is a Path in either map
+  bool blocksRing(size_t pos) const {
+    return _ringBlock.get(pos);
+  }
+
+  uint64_t ringBlockBits(size_t pos) const {
+    return _ringBlock.bitsAt(pos);
+  }
+
+  template <class Ring>
+  bool validate(size_t topPos, size_t bottomPos, Ring& ring) const {
+    assert(topPos != InvalidPos);
+    assert(bottomPos != InvalidPos);
+    if (isTopWall(topPos) || isBottomWall(bottomPos)) {
+      //positions must be in a path
+      return false;
+    } else {
+      unsigned xTop, xBottom, yTop, yBottom;
+      posToCoords(topPos, xTop, yTop);
+      posToCoords(bottomPos, xBottom, yBottom);
+      return ring.validatePinPos(xTop, yTop, xBottom, yBottom, *this);
+    }
+  }
+
+  /**
+   * For each cell, the number of moves that a pin needs to reach an Exit cell
+   * moving to one of the 8 neighbours at a time without going through a wall.
+   * top selects the map of the top pin, and cells that cannot reach an exit get UnreachableDistance.
+   */
+  void exitDistances(bool top, std::vector<unsigned> &dist) const {
+    const BitPlane &open = top ? _topOpen : _bottomOpen;
+    dist.assign(getCellCount(), (unsigned)UnreachableDistance);
+    std::vector<size_t> queue;
+    for (size_t pos = 0; pos < getCellCount(); ++pos) {
+      if (_exit.get(pos)) {
+        dist[pos] = 0;
+        queue.push_back(pos);
+      }
+    }
+    //no bounds checks: the border is made of walls
+    for (size_t i = 0; i < queue.size(); ++i) {
+      for (size_t next = queue[i] - _stride - 1; next <= queue[i] + _stride - 1; next += _stride) {
+        for (size_t n = next; n <= next + 2; ++n) {
+          if (open.get(n) && dist[n] == UnreachableDistance) {
+            dist[n] = dist[queue[i]] + 1;
+            queue.push_back(n);
+          }
+        }
+      }
+    }
+  }
+
+  /**
+   * Turns the cells from which a pin cannot reach an exit of its own map into walls of that map.
+   * No path to the exit goes through them, so the search finds the same path in fewer states.
+   * The cells that block the ring do not change.
+   */
+  void removeDeadEnds() {
+    std::vector<unsigned> dist;
+    for (unsigned top = 0; top < 2; ++top) {
+      BitPlane &open = top ? _topOpen : _bottomOpen;
+      exitDistances(top, dist);
+      for (size_t pos = 0; pos < getCellCount(); ++pos) {
+        if (dist[pos] == UnreachableDistance) {
+          open.set(pos, false);
+        }
+      }
+    }
+  }
+
+  /**
+   * Turns into walls the cells that no path of the pins goes through, for pins that start on
+   * topStart and bottomStart and a ring with these offsets:
+   *  - the cells that are not 8-connected to both the start of the pin and an exit in the pin's map,
+   *  - the cells where the pin has no partner: no open cell of the other map at one of the offsets
+   *    with the ring clear, so that no valid position has the pin there.
+   * Removing cells can make others disconnected or without partner, so this goes on until nothing changes.
+   * The cells that block the ring do not change, and neither does the path found by a breadth first search.
+   * Returns false, quickly, when a pin cannot reach any exit from its start: there is no path at all.
+   */
+  bool prune(const RingOffsets& offsets, size_t topStart, size_t bottomStart) {
+    BitPlane fromStart, fromExit;
+    std::vector<size_t> exits;
+    for (bool changed = true; changed;) {
+      changed = false;
+      for (unsigned top = 0; top < 2; ++top) {
+        BitPlane &open = top ? _topOpen : _bottomOpen;
+        floodFill(open, std::vector<size_t>(1, top ? topStart : bottomStart), fromStart);
+        exits.clear();
+        for (size_t i = 0; i < _exit.wordCount(); ++i) {
+          for (uint64_t bits = _exit.word(i) & open.word(i); bits; bits &= bits - 1) {
+            exits.push_back(64 * i + __builtin_ctzll(bits));
+          }
+        }
+        bool connected = false;
+        for (size_t i = 0; i < exits.size() && !connected; ++i) {
+          connected = fromStart.get(exits[i]);
+        }
+        if (!connected) {
+          return false;
+        }
+        floodFill(open, exits, fromExit);
+        for (size_t i = 0; i < open.wordCount(); ++i) {
+          uint64_t kept = open.word(i) & fromStart.word(i) & fromExit.word(i);
+          changed = changed || kept != open.word(i);
+          open.setWord(i, kept);
+        }
+      }
+      for (unsigned top = 0; top < 2; ++top) {
+        BitPlane &open = top ? _topOpen : _bottomOpen;
+        for (size_t i = 0; i < open.wordCount(); ++i) {
+          for (uint64_t bits = open.word(i); bits; bits &= bits - 1) {
+            size_t pos = 64 * i + __builtin_ctzll(bits);
+            if (!hasPartner(pos, top, offsets)) {
+              open.set(pos, false);
+              changed = true;
+            }
+          }
+        }
+      }
+    }
+    return true;
+  }
+
+  /**
+   * The labyrinth with cells twice as large, for a coarse search (see LabySolver::setLevels).
+   * A cell is open in a map only if a pin can cross its 2x2 block: each row, or each column, of the block
+   * has an open cell, which keeps the passages one cell wide. It is an exit if the block has one, and blocks
+   * the ring if any cell of the block does. The last block of an odd width or height is one cell wide.
+   */
+  Laby halved() const {
+    Laby coarse((_w + 1) / 2, (_h + 1) / 2);
+    for (unsigned y = 0; y < coarse._h; ++y) {
+      for (unsigned x = 0; x < coarse._w; ++x) {
+        size_t block[4] = {coordsToPos(2*x, 2*y), coordsToPos(std::min(2*x + 1, _w - 1), 2*y),
+                           coordsToPos(2*x, std::min(2*y + 1, _h - 1)), coordsToPos(std::min(2*x + 1, _w - 1), std::min(2*y + 1, _h - 1))};
+        bool open[2], exit = false, ringBlock = false;
+        for (unsigned top = 0; top < 2; ++top) {
+          const BitPlane &fine = top ? _topOpen : _bottomOpen;
+          bool row0 = fine.get(block[0]) || fine.get(block[1]), row1 = fine.get(block[2]) || fine.get(block[3]);
+          bool column0 = fine.get(block[0]) || fine.get(block[2]), column1 = fine.get(block[1]) || fine.get(block[3]);
+          open[top] = (row0 && row1) || (column0 && column1);
+        }
+        for (unsigned i = 0; i < 4; ++i) {
+          exit = exit || _exit.get(block[i]);
+          ringBlock = ringBlock || _ringBlock.get(block[i]);
+        }
+        size_t pos = coarse.coordsToPos(x, y);
+        coarse.setCell(pos, open[1], open[0], exit);
+        coarse._ringBlock.set(pos, ringBlock);
+      }
+    }
+    return coarse;
+  }
+
+  //turns into walls the cells of each map that are not set in topCells and bottomCells; the cells that block the ring do not change
+  void keepCells(const BitPlane& topCells, const BitPlane& bottomCells) {
+    for (size_t i = 0; i < _topOpen.wordCount(); ++i) {
+      _topOpen.setWord(i, _topOpen.word(i) & topCells.word(i));
+      _bottomOpen.setWord(i, _bottomOpen.word(i) & bottomCells.word(i));
+    }
+  }
+
+  //writes the labyrinth to a PPM file, like the input, with the pins in blue
+  bool draw(const char* filename, size_t topPos, size_t bottomPos) const {
+    return PnmWriter::write(filename, _w, _h, PnmWriter::PPM, [&](unsigned y, unsigned char* rgb) {
+      for (unsigned x = 0; x < _w; ++x) {
+        size_t pos = coordsToPos(x, y);
+        bool pin = pos == topPos || pos == bottomPos;
+        rgb[3*x] = pin ? 0 : cellType(_topOpen, pos); //R
+        rgb[3*x + 1] = pin ? 0 : cellType(_bottomOpen, pos); //G
+        rgb[3*x + 2] = pin || _exit.get(pos) ? 255 : 0; //B
+      }
+    }, &std::cerr);
+  }
+
+
+private:
+
+  void allocate() {
+    _stride = (_w + 2 + 63) / 64 * 64;
+    _topOpen.resize(getCellCount());
+    _bottomOpen.resize(getCellCount());
+    _exit.resize(getCellCount());
+    _ringBlock.resize(getCellCount());
+  }
+
+  //exits are open in both maps
+  void setCell(size_t pos, bool topOpen, bool bottomOpen, bool exit) {
+    _topOpen.set(pos, topOpen || exit);
+    _bottomOpen.set(pos, bottomOpen || exit);
+    _exit.set(pos, exit);
+    _ringBlock.set(pos, !exit && (topOpen || bottomOpen));
+  }
+
+  /**
+   * The cells of 'open' that are 8-connected to one of the seeds, and the seeds whether they are open or not.
+   * Rows start on a word boundary, so this works on words: a word takes the cells next to the reached
+   * cells of the 8 words around it, then spreads along its row, and the words around are queued when it changes.
+   */
+  void floodFill(const BitPlane& open, const std::vector<size_t>& seeds, BitPlane& reached) const {
+    reached.resize(getCellCount());
+    size_t rowWords = _stride / 64;
+    size_t nWords = reached.wordCount();
+    std::vector<size_t> queue;
+    std::vector<bool> queued(nWords, false);
+    //the word and the 8 words around it, that take cells from it
+    auto pushAround = [&](size_t i) {
+      for (size_t row = i < rowWords ? i : i - rowWords; row <= i + rowWords; row += rowWords) {
+        for (size_t j = row - 1; j <= row + 1; ++j) {
+          if (j < nWords && !queued[j]) {
+            queued[j] = true;
+            queue.push_back(j);
+          }
+        }
+      }
+    };
+    for (size_t i = 0; i < seeds.size(); ++i) {
+      reached.set(seeds[i], true);
+      pushAround(seeds[i] >> 6);
+    }
+    while (!queue.empty()) {
+      size_t i = queue.back();
+      queue.pop_back();
+      queued[i] = false;
+      uint64_t around = 0;
+      for (size_t row = i < rowWords ? i : i - rowWords; row <= i + rowWords && row < nWords; row += rowWords) {
+        uint64_t bits = reached.word(row);
+        around |= bits | bits << 1 | bits >> 1;
+        around |= row > 0 ? reached.word(row - 1) >> 63 : 0;
+        around |= row + 1 < nWords ? reached.word(row + 1) << 63 : 0;
+      }
+      uint64_t cells = open.word(i);
+      uint64_t next = reached.word(i) | (around & cells);
+      for (uint64_t previous = 0; previous != next;) {
+        previous = next;
+        next |= (next << 1 | next >> 1) & cells;
+      }
+      if (next != reached.word(i)) {
+        reached.setWord(i, next);
+        pushAround(i);
+      }
+    }
+  }
+
+  //whether a pin on pos, in the top map or not, has an open cell of the other map at one of the offsets with the ring clear
+  bool hasPartner(size_t pos, bool top, const RingOffsets& offsets) const {
+    const BitPlane &other = top ? _bottomOpen : _topOpen;
+    unsigned x, y;
+    posToCoords(pos, x, y);
+    for (unsigned i = 0; i < offsets.size(); ++i) {
+      int sign = top ? 1 : -1;
+      int xOther = x + sign * offsets.dx(i);
+      int yOther = y + sign * offsets.dy(i);
+      if (xOther < 0 || xOther >= (int)_w || yOther < 0 || yOther >= (int)_h || !other.get(coordsToPos(xOther, yOther))) {
+        continue;
+      }
+      //the ring point is relative to the bottom pin, like in StateEncoding::ringClear
+      int xRing = (unsigned)((top ? xOther : x) + offsets.ringX(i) + 0.5);
+      int yRing = (unsigned)((top ? yOther : y) + offsets.ringY(i) + 0.5);
+      if (xRing < 0 || xRing >= (int)_w || yRing < 0 || yRing >= (int)_h || !_ringBlock.get(coordsToPos(xRing, yRing))) {
+        return true;
+      }
+    }
+    return false;
+  }
+
+  CellType cellType(const BitPlane& open, size_t pos) const {
+    return _exit.get(pos) ? Exit : (open.get(pos) ? Path : Wall);
+  }
+
+  unsigned _w;
+  unsigned _h;
+  size_t _stride;
+  BitPlane _topOpen;
+  BitPlane _bottomOpen;
+  BitPlane _exit;
+  BitPlane _ringBlock;
+};
+
+
+/**
+ * Counters of a search. StateEncoding::forEachValidMove and the searches take the type
+ * of their counters as a template parameter, and with NoSearchStats all the counting
+ * compiles away.
+ */
+struct SearchStats {
+  static const bool Enabled = true;
+
+  SearchStats(): expanded(0), moves(0), outOfBounds(0), wall(0), distance(0), ring(0), sweep(0),
+                 visitedHits(0), peakFrontier(0), storeBytes(0) {
+  }
+
+  void expandedState(unsigned outOfBoundsMoves, unsigned wallMoves, unsigned distanceMoves) {
+    ++expanded;
+    moves += 81;
+    outOfBounds += outOfBoundsMoves;
+    wall += wallMoves;
+    distance += distanceMoves;
+  }
+
+  void ringRejected() {
+    ++ring;
+  }
+
+  void sweepRejected() {
+    ++sweep;
+  }
+
+  void visitedHit(uint64_t n = 1) {
+    visitedHits += n;
+  }
+
+  void frontier(size_t size) {
+    peakFrontier = std::max(peakFrontier, (uint64_t)size);
+  }
+
+  //adds the counters of another thread
+  void add(const SearchStats& other) {
+    expanded += other.expanded;
+    moves += other.moves;
+    outOfBounds += other.outOfBounds;
+    wall += other.wall;
+    distance += other.distance;
+    ring += other.ring;
+    sweep += other.sweep;
+    visitedHits += other.visitedHits;
+    peakFrontier = std::max(peakFrontier, other.peakFrontier);
+  }
+
+  uint64_t expanded; //states whose moves were enumerated
+  uint64_t moves; //moves tested, 81 per expanded state
+  uint64_t outOfBounds; //rejected: a pin leaves the labyrinth
+  uint64_t wall; //rejected: a pin goes into a wall
+  uint64_t distance; //rejected: the pins are not at the ring distance any more
+  uint64_t ring; //rejected: the ring touches a path
+  uint64_t sweep; //rejected: the ring goes through a path on the way (see StateEncoding)
+  uint64_t visitedHits; //valid moves to states already visited
+  uint64_t peakFrontier; //largest layer, or open list for A*
+  uint64_t storeBytes; //memory of the visited stores, set by LabySolver
+};
+
+
+struct NoSearchStats {
+  static const bool Enabled = false;
+
+  void expandedState(unsigned, unsigned, unsigned) {
+  }
+
+  void ringRejected() {
+  }
+
+  void sweepRejected() {
+  }
+
+  void visitedHit(uint64_t = 1) {
+  }
+
+  void frontier(size_t) {
+  }
+
+  void add(const NoSearchStats&) {
+  }
+};
+
+
+/**
+ * Compact encoding of a (topPos, bottomPos) state as topPos * nOffsets + offsetIndex,
+ * where offsetIndex is the index of bottomPos - topPos in the RingOffsets table.
+ *
+ * Also enumerates the moves out of a state. There are 81 (l/s/r)*(t/s/b)*(l/s/r)*(t/s/b) moves,
+ * indexed by 9 * (top pin move) + (bottom pin move), each pin move in (l/s/r)*(t/s/b) order.
+ * In the bordered labyrinth, a move only adds fixed deltas to the pin positions and a fixed
+ * shift to the ring offset, so moves are looked up in tables, and the wall tests of all
+ * 81 moves are done at once on bit masks.
+ *
+ * With 'sweep', a move is also rejected if the ring goes through a path on its way
+ * to the new position. The cells it goes through are computed once for each offset
+ * and move (see RingOffsets::sweep), and tested a row at a time on the bit planes.
+ */
+class StateEncoding {
+  public:
+    static const size_t InvalidState = std::numeric_limits<size_t>::max();
+    static const unsigned NoMove = 40; //both pins stay in place
+
+    StateEncoding(const Laby& laby, const Ring& ring, bool sweep = false): StateEncoding(laby, RingOffsets(ring), sweep) {
+    }
+
+    StateEncoding(const Laby& laby, const RingOffsets& offsets, bool sweep = false)
+     : _laby(laby), _offsets(offsets), _nOffsets(_offsets.size()), _sweep(sweep) {
+      for (int k = 0; k < 9; ++k) {
+        _pinDelta[k] = (int)laby.getStride() * (k / 3 - 1) + (k % 3 - 1);
+      }
+      for (unsigned i = 0; i < 81; ++i) {
+        int dxTop = (i / 9) % 3 - 1, dyTop = (i / 9) / 3 - 1;
+        int dxBottom = (i % 9) % 3 - 1, dyBottom = (i % 9) / 3 - 1;
+        Move& move = _moves[i];
+        move.topDelta = _pinDelta[i / 9];
+        move.bottomDelta = _pinDelta[i % 9];
+        move.dxBottom = dxBottom;
+        move.dyBottom = dyBottom;
+        move.shift = RingOffsets::shiftIndex(dxBottom - dxTop, dyBottom - dyTop);
+        move.code = 27 * (dxTop + 1) + 9 * (dyTop + 1) + 3 * (dxBottom + 1) + (dyBottom + 1);
+        _moveOfCode[move.code] = i;
+      }
+      _bottomOpenMoves = 0;
+      for (unsigned top = 0; top < 9; ++top) {
+        _bottomOpenMoves |= (MoveMask)1 << (9 * top);
+      }
+      for (unsigned k = 0; k < 512; ++k) {
+        _topOpenMoves[k] = 0;
+        for (unsigned top = 0; top < 9; ++top) {
+          if ((k >> top) & 1) {
+            _topOpenMoves[k] |= (MoveMask)0x1ff << (9 * top);
+          }
+        }
+      }
+      _bottomDelta.resize(_nOffsets);
+      _offsetMoves.resize(_nOffsets);
+      for (unsigned offset = 0; offset < _nOffsets; ++offset) {
+        _bottomDelta[offset] = (long)laby.getStride() * _offsets.dy(offset) + _offsets.dx(offset);
+        _offsetMoves[offset] = 0;
+        for (unsigned i = 0; i < 81; ++i) {
+          if (i != NoMove && _offsets.shifted(offset, _moves[i].shift) != RingOffsets::InvalidOffset) {
+            _offsetMoves[offset] |= (MoveMask)1 << i;
+          }
+        }
+      }
+      if (_sweep) {
+        _sweepBegin.resize(81 * _nOffsets + 1);
+        for (unsigned offset = 0; offset < _nOffsets; ++offset) {
+          for (unsigned i = 0; i < 81; ++i) {
+            _sweepBegin[81 * offset + i] = _sweepSpans.size();
+            if ((_offsetMoves[offset] >> i) & 1) {
+              _offsets.sweep(offset, _moves[i].dxBottom, _moves[i].dyBottom,
+                             _offsets.shifted(offset, _moves[i].shift), _sweepSpans);
+            }
+          }
+        }
+        _sweepBegin.back() = _sweepSpans.size();
+      }
+    }
+
+    size_t size() const {
+      return _laby.getCellCount() * _nOffsets;
+    }
+
+    const Laby& getLaby() const {
+      return _laby;
+    }
+
+    const RingOffsets& getOffsets() const {
+      return _offsets;
+    }
+
+    //a hash of the labyrinth, the ring offsets and points and the sweep check, which tells if saved states are states of this encoding
+    uint64_t fingerprint() const {
+      uint64_t hash = 14695981039346656037ULL;
+      auto add = [&](uint64_t value) {
+        hash = (hash ^ value) * 1099511628211ULL;
+      };
+      add(_laby.getWidth());
+      add(_laby.getHeight());
+      add(_sweep);
+      for (unsigned offset = 0; offset < _nOffsets; ++offset) {
+        add((uint32_t)_offsets.dx(offset));
+        add((uint32_t)_offsets.dy(offset));
+        double ring[2] = {_offsets.ringX(offset), _offsets.ringY(offset)};
+        uint64_t bits[2];
+        memcpy(bits, ring, sizeof(bits));
+        add(bits[0]);
+        add(bits[1]);
+      }
+      for (unsigned y = 0; y < _laby.getHeight(); ++y) {
+        for (unsigned x = 0; x < _laby.getWidth(); ++x) {
+          size_t pos = _laby.coordsToPos(x, y);
+          add(_laby.atTop(pos) << 8 | _laby.atBottom(pos));
+        }
+      }
+      return hash;
+    }
+
+    size_t stateOf(size_t topPos, size_t bottomPos) const {
+      unsigned xt, yt, xb, yb;
+      _laby.posToCoords(topPos, xt, yt);
+      _laby.posToCoords(bottomPos, xb, yb);
+      unsigned offset = _offsets.indexOf((int)xb - (int)xt, (int)yb - (int)yt);
+      if (offset == RingOffsets::InvalidOffset) {
+        return InvalidState;
+      }
+      return topPos * _nOffsets + offset;
+    }
+
+    void posOf(size_t state, size_t &topPos, size_t &bottomPos) const {
+      assert(state != InvalidState);
+      topPos = state / _nOffsets;
+      bottomPos = topPos + _bottomDelta[state - topPos * _nOffsets];
+    }
+
+    /**
+     * Calls f(nextState, nextTopPos, nextBottomPos, moveCode) for each move out of 'state'
+     * that leads to a valid position (see Laby::validate), in move order.
+     * moveCode is (dxTop, dyTop, dxBottom, dyBottom) in {-1,0,1}^4, as a base 3 number.
+     */
+    template <class F>
+    void forEachValidMove(size_t state, F f) const {
+      NoSearchStats stats;
+      forEachValidMove(state, f, stats);
+    }
+
+    //counting the rejected moves in stats
+    template <class F, class Stats>
+    void forEachValidMove(size_t state, F f, Stats& stats) const {
+      size_t topPos = state / _nOffsets;
+      unsigned offset = state - topPos * _nOffsets;
+      size_t bottomPos = topPos + _bottomDelta[offset];
+      unsigned xb, yb;
+      _laby.posToCoords(bottomPos, xb, yb);
+      //which of the 9 cells around each pin are open, 3 bits per row
+      size_t stride = _laby.getStride();
+      unsigned topOpen = (_laby.topOpenBits(topPos - stride - 1) & 7) |
+                         (_laby.topOpenBits(topPos - 1) & 7) << 3 |
+                         (_laby.topOpenBits(topPos + stride - 1) & 7) << 6;
+      unsigned bottomOpen = (_laby.bottomOpenBits(bottomPos - stride - 1) & 7) |
+                            (_laby.bottomOpenBits(bottomPos - 1) & 7) << 3 |
+                            (_laby.bottomOpenBits(bottomPos + stride - 1) & 7) << 6;
+      MoveMask candidates = _offsetMoves[offset] & _topOpenMoves[topOpen] & (bottomOpen * _bottomOpenMoves);
+      if (Stats::Enabled) {
+        unsigned xt, yt;
+        _laby.posToCoords(topPos, xt, yt);
+        MoveMask inside = _offsetMoves[offset] & _topOpenMoves[insideMask(xt, yt)] & (insideMask(xb, yb) * _bottomOpenMoves);
+        stats.expandedState(countMoves(_offsetMoves[offset] & ~inside), countMoves(inside & ~candidates),
+                            81 - countMoves(_offsetMoves[offset]));
+      }
+      while (candidates) {
+        unsigned i = lowestMove(candidates);
+        candidates &= candidates - 1;
+        const Move& move = _moves[i];
+        unsigned nextOffset = _offsets.shifted(offset, move.shift);
+        if (!ringClear(nextOffset, xb + move.dxBottom, yb + move.dyBottom)) {
+          stats.ringRejected();
+        } else if (_sweep && !sweepClear(offset, i, xb, yb)) {
+          stats.sweepRejected();
+        } else {
+          size_t nextTopPos = topPos + move.topDelta;
+          f(nextTopPos * _nOffsets + nextOffset, nextTopPos, bottomPos + move.bottomDelta, move.code);
+        }
+      }
+    }
+
+    /**
+     * Calls f(prevState, moveCode) for each state from which 'state' can be reached in one move,
+     * whether or not that state is valid, in move order. moveCode is the code of the move from prevState to state.
+     * The moves are symmetric, so these are the states reached by the moves out of 'state'.
+     * With 'sweep', the neighbours that the ring cannot go to 'state' from are skipped.
+     */
+    template <class F>
+    void forEachNeighbour(size_t state, F f) const {
+      size_t topPos = state / _nOffsets;
+      unsigned offset = state - topPos * _nOffsets;
+      unsigned xb = 0, yb = 0;
+      if (_sweep) {
+        _laby.posToCoords(topPos + _bottomDelta[offset], xb, yb);
+      }
+      for (unsigned i = 0; i < 81; ++i) {
+        if (((_offsetMoves[offset] >> i) & 1) && (!_sweep || sweepClear(offset, i, xb, yb))) {
+          const Move& move = _moves[i];
+          f((topPos + move.topDelta) * _nOffsets + _offsets.shifted(offset, move.shift), 80 - move.code);
+        }
+      }
+    }
+
+    //the state from which 'state' was reached by the move with code moveCode
+    size_t undoMove(size_t state, unsigned char moveCode) const {
+      const Move& move = _moves[_moveOfCode[80 - moveCode]];
+      size_t topPos = state / _nOffsets;
+      unsigned offset = state - topPos * _nOffsets;
+      return (topPos + move.topDelta) * _nOffsets + _offsets.shifted(offset, move.shift);
+    }
+
+  private:
+    typedef unsigned __int128 MoveMask; //one bit per move
+
+    struct Move {
+      int topDelta;
+      int bottomDelta;
+      int dxBottom;
+      int dyBottom;
+      unsigned shift;
+      unsigned char code;
+    };
+
+    static unsigned lowestMove(MoveMask moves) {
+      uint64_t low = (uint64_t)moves;
+      return low ? __builtin_ctzll(low) : 64 + __builtin_ctzll((uint64_t)(moves >> 64));
+    }
+
+    static unsigned countMoves(MoveMask moves) {
+      return __builtin_popcountll((uint64_t)moves) + __builtin_popcountll((uint64_t)(moves >> 64));
+    }
+
+    //which of the 9 cells around (x, y) are in the labyrinth, like the open cells in forEachValidMove
+    unsigned insideMask(unsigned x, unsigned y) const {
+      unsigned columns = (x > 0 ? 1 : 0) | 2 | (x + 1 < _laby.getWidth() ? 4 : 0);
+      return (y > 0 ? columns : 0) | columns << 3 | (y + 1 < _laby.getHeight() ? columns << 6 : 0);
+    }
+
+    //the ring must not touch a path, see Ring::validatePinPos
+    bool ringClear(unsigned offset, unsigned xBottom, unsigned yBottom) const {
+      int x = (unsigned)(xBottom + _offsets.ringX(offset) + 0.5);
+      int y = (unsigned)(yBottom + _offsets.ringY(offset) + 0.5);
+      if (x >= 0 && x < (int)_laby.getWidth() && y >= 0 && y < (int)_laby.getHeight()) {
+        return !_laby.blocksRing(_laby.coordsToPos(x, y));
+      }
+      return true;
+    }
+
+    //the ring does not go through a path during move i from offset, with the bottom pin at (xBottom, yBottom)
+    bool sweepClear(unsigned offset, unsigned i, unsigned xBottom, unsigned yBottom) const {
+      const RingOffsets::Span* span = &_sweepSpans[_sweepBegin[81 * offset + i]];
+      const RingOffsets::Span* end = &_sweepSpans[0] + _sweepBegin[81 * offset + i + 1];
+      for (; span != end; ++span) {
+        int x = (int)xBottom + span->dx;
+        int y = (int)yBottom + span->dy;
+        if (y < 0 || y >= (int)_laby.getHeight() || x >= (int)_laby.getWidth()) {
+          continue;
+        }
+        uint64_t mask = span->mask;
+        if (x < 0) {
+          mask = -x < 64 ? mask >> -x : 0;
+          x = 0;
+        }
+        if (_laby.getWidth() - x < 64) {
+          mask &= ((uint64_t)1 << (_laby.getWidth() - x)) - 1;
+        }
+        if (_laby.ringBlockBits(_laby.coordsToPos(x, y)) & mask) {
+          return false;
+        }
+      }
+      return true;
+    }
+
+    const Laby& _laby;
+    RingOffsets _offsets;
+    unsigned _nOffsets;
+    bool _sweep;
+    int _pinDelta[9];
+    Move _moves[81];
+    unsigned char _moveOfCode[81];
+    MoveMask _topOpenMoves[512]; //moves allowed by the open cells around the top pin
+    MoveMask _bottomOpenMoves; //times the open cells around the bottom pin, moves allowed by them
+    std::vector<MoveMask> _offsetMoves; //moves that keep the pins at a valid distance
+    std::vector<long> _bottomDelta;
+    std::vector<size_t> _sweepBegin; //index in _sweepSpans of the cells of each (offset, move)
+    std::vector<RingOffsets::Span> _sweepSpans;
+
+    StateEncoding();
+};
+
+
+struct VisitedPos {
+    VisitedPos(): time(0xffffffff), prevObjOffset(std::numeric_limits<size_t>::max()) {
+    }
+    unsigned time;
+    size_t prevObjOffset; //'pointer' to previous visited pos
+};
+
+struct VisitedPositionsHashMap {
+  VisitedPositionsHashMap() {
+  }
+
+  VisitedPositionsHashMap(const StateEncoding&) {
+  }
+
+  //forgets all states, keeping the buckets
+  void reset(const StateEncoding&) {
+    _visited.clear();
+  }
+
+  bool operator() (size_t state, unsigned time) const {
+    std::unordered_map<size_t, VisitedPos>::const_iterator it = _visited.find(state);
+    return it != _visited.end() && it->second.time <= time;
+  }
+
+  void set(size_t state, unsigned time, size_t prevState, unsigned char) {
+    assert(!(*this)(state, time));
+    VisitedPos &vp = _visited[state];
+    vp.time = time;
+    vp.prevObjOffset = prevState;
+  }
+
+  void setOrigin(size_t state) {
+    VisitedPos &vp = _visited[state];
+    vp.time = 0;
+    vp.prevObjOffset = std::numeric_limits<size_t>::max();
+  }
+
+  size_t prevOf(size_t offset) const {
+    std::unordered_map<size_t, VisitedPos>::const_iterator it = _visited.find(offset);
+    assert(it != _visited.end());
+    return it->second.prevObjOffset;
+  }
+
+  //an estimate: the nodes, with their next pointer and hash, and the buckets
+  size_t sizeInBytes() const {
+    return _visited.size() * (sizeof(std::pair<const size_t, VisitedPos>) + 2 * sizeof(void*)) + _visited.bucket_count() * sizeof(void*);
+  }
+
+  private:
+    std::unordered_map<size_t, VisitedPos> _visited;
+};
+
+/**
+ * Visited positions stored in flat arrays indexed by compact state id.
+ * Membership is a bitmap kept apart from the parent data so that it stays in cache,
+ * and the parent is stored as the 1-byte code of the move that led to the state.
+ * Times are not stored: the search expands states by increasing time, so
+ * the first visit of a state is always the earliest one.
+ */
+struct VisitedPositionsArray {
+  static const unsigned char OriginMove = 0xff;
+
+  VisitedPositionsArray(): _states(NULL), _capacity(0) {
+  }
+
+  VisitedPositionsArray(const StateEncoding& states): _states(NULL), _capacity(0) {
+    reset(states);
+  }
+
+  //forgets all states, for a search on 'states', reusing the memory when it is large enough
+  void reset(const StateEncoding& states) {
+    _states = &states;
+    _seen.assign((states.size() + 63) / 64, 0);
+    if (states.size() > _capacity) {
+      _capacity = states.size();
+      _move.reset(new unsigned char[_capacity]);
+    }
+  }
+
+  bool operator() (size_t state, unsigned) const {
+    return seen(state);
+  }
+
+  void set(size_t state, unsigned time, size_t, unsigned char move) {
+    assert(!(*this)(state, time));
+    _seen[state >> 6] |= (uint64_t)1 << (state & 63);
+    _move[state] = move;
+  }
+
+  void setOrigin(size_t state) {
+    _seen[state >> 6] |= (uint64_t)1 << (state & 63);
+    _move[state] = OriginMove;
+  }
+
+  //for searches that share the store between threads
+  bool seen(size_t state) const {
+    return (_seen[state >> 6] >> (state & 63)) & 1;
+  }
+
+  void markSeenAtomic(size_t state) {
+    __atomic_fetch_or(&_seen[state >> 6], (uint64_t)1 << (state & 63), __ATOMIC_RELAXED);
+  }
+
+  void setMove(size_t state, unsigned char move) {
+    _move[state] = move;
+  }
+
+  size_t sizeInBytes() const {
+    return _seen.size() * sizeof(uint64_t) + _capacity;
+  }
+
+  //the arrays, for SearchCheckpoint: a bit per state, and a move code per state
+  uint64_t* seenWords() {
+    return _seen.data();
+  }
+
+  const uint64_t* seenWords() const {
+    return _seen.data();
+  }
+
+  unsigned char* moves() {
+    return _move.get();
+  }
+
+  const unsigned char* moves() const {
+    return _move.get();
+  }
+
+  size_t prevOf(size_t offset) const {
+    unsigned char move = _move[offset];
+    if (move == OriginMove) {
+      return std::numeric_limits<size_t>::max();
+    }
+    return _states->undoMove(offset, move);
+  }
+
+  private:
+    const StateEncoding* _states;
+    std::vector<uint64_t> _seen;
+    std::unique_ptr<unsigned char[]> _move;
+    size_t _capacity;
+};
+
+
+/**
+ * Saves a breadth first search at layer boundaries, so that it can go on after the
+ * process is killed. The file is a Header, then the seen bitmap and the move codes
+ * of the VisitedPositionsArray, then the states of the layer, each part starting at
+ * a multiple of 8 bytes, so that it can be mapped and used in place.
+ *
+ * The file is written by a forked child process on a copy-on-write snapshot of the
+ * search, so the search only waits for the fork. It goes to <filename>.tmp first
+ * and is renamed when complete, so the last complete checkpoint is never lost.
+ * Only the dense store is saved.
+ */
+class SearchCheckpoint {
+  public:
+    struct Header {
+      char magic[8];
+      uint64_t fingerprint; //see StateEncoding::fingerprint
+      uint64_t nStates;
+      uint64_t layerSize;
+      uint32_t time;
+      uint32_t stateIdBytes;
+    };
+
+    //a checkpoint every 'interval' seconds
+    SearchCheckpoint(const std::string& filename, unsigned interval)
+     : _filename(filename), _tmpFilename(filename + ".tmp"), _interval(interval), _last(std::chrono::steady_clock::now()),
+       _writer(-1), _resumed(false), _resumeTime(0) {
+    }
+
+    ~SearchCheckpoint() {
+      wait();
+    }
+
+    const std::string& getFilename() const {
+      return _filename;
+    }
+
+    //saves the search if the interval is over and the last checkpoint is written
+    template <class StateId>
+    void update(const StateEncoding& states, const VisitedPositionsArray& store, unsigned time, const std::vector<StateId>& layer) {
+      if (std::chrono::steady_clock::now() - _last < std::chrono::seconds(_interval)) {
+        return;
+      }
+      if (!reap(false)) {
+        return;
+      }
+      _last = std::chrono::steady_clock::now();
+      save(states, store, time, layer);
+    }
+
+    //no-op: only the dense store is saved
+    template <class StateId>
+    void update(const StateEncoding&, const VisitedPositionsHashMap&, unsigned, const std::vector<StateId>&) {
+    }
+
+    //starts writing the search at 'time', whose layer is 'layer', in a child process
+    template <class StateId>
+    void save(const StateEncoding& states, const VisitedPositionsArray& store, unsigned time, const std::vector<StateId>& layer) {
+      wait();
+      Header header;
+      memcpy(header.magic, "LABYCKP1", 8);
+      header.fingerprint = states.fingerprint();
+      header.nStates = states.size();
+      header.layerSize = layer.size();
+      header.time = time;
+      header.stateIdBytes = sizeof(StateId);
+      //no allocation after fork(), the other threads may hold the malloc lock
+      const char* tmpFilename = _tmpFilename.c_str();
+      const char* filename = _filename.c_str();
+      pid_t pid = fork();
+      if (pid < 0) {
+        std::cerr << "Cannot fork to write the checkpoint: " << strerror(errno) << std::endl;
+        return;
+      }
+      if (pid > 0) {
+        _writer = pid;
+        return;
+      }
+      int fd = ::open(tmpFilename, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      bool ok = fd >= 0
+        && writeAll(fd, &header, sizeof(header))
+        && writeAll(fd, store.seenWords(), seenBytes(header.nStates))
+        && writeAll(fd, store.moves(), header.nStates)
+        && writeAll(fd, "\0\0\0\0\0\0\0", padding(header.nStates))
+        && writeAll(fd, layer.data(), layer.size() * sizeof(StateId))
+        && fsync(fd) == 0;
+      ok = fd >= 0 && close(fd) == 0 && ok && rename(tmpFilename, filename) == 0;
+      _exit(ok ? 0 : 1);
+    }
+
+    /**
+     * Loads the search saved in the file into 'store', which must have been reset for
+     * 'states', and into 'layer'. The search then goes on from there (see resumed()).
+     * Returns false, with a message on err, if there is no checkpoint, or if it was
+     * saved for other states.
+     */
+    template <class StateId>
+    bool load(const StateEncoding& states, VisitedPositionsArray& store, std::vector<StateId>& layer, std::ostream* err) {
+      MappedFile file;
+      if (!file.open(_filename.c_str())) {
+        if (err) {
+          *err << "Cannot open checkpoint '" << _filename << "'" << std::endl;
+        }
+        return false;
+      }
+      size_t size = file.end() - file.begin();
+      Header header;
+      if (size < sizeof(header)) {
+        memset(&header, 0, sizeof(header));
+      } else {
+        memcpy(&header, file.begin(), sizeof(header));
+      }
+      size_t layerBegin = sizeof(header) + seenBytes(header.nStates) + header.nStates + padding(header.nStates);
+      if (memcmp(header.magic, "LABYCKP1", 8) != 0 || header.stateIdBytes != sizeof(StateId)
+          || size != layerBegin + header.layerSize * sizeof(StateId)) {
+        if (err) {
+          *err << "'" << _filename << "' is not a checkpoint" << std::endl;
+        }
+        return false;
+      }
+      if (header.fingerprint != states.fingerprint() || header.nStates != states.size()) {
+        if (err) {
+          *err << "Checkpoint '" << _filename << "' is for another labyrinth or ring" << std::endl;
+        }
+        return false;
+      }
+      const unsigned char* data = file.begin() + sizeof(header);
+      memcpy(store.seenWords(), data, seenBytes(header.nStates));
+      memcpy(store.moves(), data + seenBytes(header.nStates), header.nStates);
+      const StateId* saved = (const StateId*)(file.begin() + layerBegin);
+      layer.assign(saved, saved + header.layerSize);
+      _resumeTime = header.time;
+      _resumed = true;
+      return true;
+    }
+
+    //true once after load(), with the time of the loaded layer
+    bool resumed(unsigned& time) {
+      time = _resumeTime;
+      bool resumed = _resumed;
+      _resumed = false;
+      return resumed;
+    }
+
+    //waits for the checkpoint being written, if any
+    void wait() {
+      reap(true);
+    }
+
+  private:
+    //true if no checkpoint is being written, waiting for the one being written if 'block'
+    bool reap(bool block) {
+      if (_writer < 0) {
+        return true;
+      }
+      int status;
+      pid_t pid = waitpid(_writer, &status, block ? 0 : WNOHANG);
+      if (pid == 0) {
+        return false;
+      }
+      if (pid == _writer && !(WIFEXITED(status) && WEXITSTATUS(status) == 0)) {
+        std::cerr << "Cannot write checkpoint '" << _filename << "'" << std::endl;
+      }
+      _writer = -1;
+      return true;
+    }
+
+    static size_t seenBytes(size_t nStates) {
+      return (nStates + 63) / 64 * 8;
+    }
+
+    static size_t padding(size_t nStates) {
+      return (8 - nStates % 8) % 8;
+    }
+
+    static bool writeAll(int fd, const void* data, size_t size) {
+      const char* p = (const char*)data;
+      while (size > 0) {
+        ssize_t n = write(fd, p, size);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          return false;
+        }
+        p += n;
+        size -= n;
+      }
+      return true;
+    }
+
+    std::string _filename;
+    std::string _tmpFilename;
+    unsigned _interval;
+    std::chrono::steady_clock::time_point _last;
+    pid_t _writer;
+    bool _resumed;
+    unsigned _resumeTime;
+
+    SearchCheckpoint(const SearchCheckpoint&);
+    void operator=(const SearchCheckpoint&);
+};
+
+/**
+ * A fixed set of threads that all run the same function with their own thread index.
+ * The calling thread takes part as thread 0.
+ */
+class WorkerPool {
+  public:
+    WorkerPool(unsigned nThreads): _nThreads(nThreads), _task(NULL), _generation(0), _running(0), _stop(false) {
+      for (unsigned i = 1; i < _nThreads; ++i) {
+        _threads.push_back(std::thread(&WorkerPool::work, this, i));
+      }
+    }
+
+    ~WorkerPool() {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _stop = true;
+      }
+      _wake.notify_all();
+      for (size_t i = 0; i < _threads.size(); ++i) {
+        _threads[i].join();
+      }
+    }
+
+    unsigned size() const {
+      return _nThreads;
+    }
+
+    //runs f(0) ... f(size() - 1) in parallel and waits for all of them
+    void run(const std::function<void(unsigned)>& f) {
+      {
+        std::unique_lock<std::mutex> lock(_mutex);
+        _task = &f;
+        _running = _nThreads - 1;
+        ++_generation;
+      }
+      _wake.notify_all();
+      f(0);
+      std::unique_lock<std::mutex> lock(_mutex);
+      _done.wait(lock, [this]() { return _running == 0; });
+    }
+
+    //the [begin, end) part of [0, n) that thread 'index' should process
+    void chunk(unsigned index, size_t n, size_t &begin, size_t &end) const {
+      begin = n * index / _nThreads;
+      end = n * (index + 1) / _nThreads;
+    }
+
+  private:
+    void work(unsigned index) {
+      unsigned long generation = 0;
+      for (;;) {
+        const std::function<void(unsigned)>* task;
+        {
+          std::unique_lock<std::mutex> lock(_mutex);
+          _wake.wait(lock, [&]() { return _stop || _generation != generation; });
+          if (_stop) {
+            return;
+          }
+          generation = _generation;
+          task = _task;
+        }
+        (*task)(index);
+        std::unique_lock<std::mutex> lock(_mutex);
+        if (--_running == 0) {
+          _done.notify_one();
+        }
+      }
+    }
+
+    unsigned _nThreads;
+    std::vector<std::thread> _threads;
+    std::mutex _mutex;
+    std::condition_variable _wake;
+    std::condition_variable _done;
+    const std::function<void(unsigned)>* _task;
+    unsigned long _generation;
+    unsigned _running;
+    bool _stop;
+
+    WorkerPool();
+    WorkerPool(const WorkerPool&);
+};
+
+//a position of both pins along a path, in pixels
+struct PathStep {
+  unsigned time;
+  unsigned topX;
+  unsigned topY;
+  unsigned bottomX;
+  unsigned bottomY;
+};
+
+/**
+ * Prints the path, from the last step to the first one, for a labyrinth of width * height cells.
+ */
+inline void printPath(std::ostream& os, unsigned width, unsigned height, double diameter, const std::vector<PathStep>& path) {
+  for (size_t i = path.size(); i-- > 0;) {
+    unsigned xt = path[i].topX, yt = path[i].topY, xb = path[i].bottomX, yb = path[i].bottomY;
+    os << path[i].time;
+    //write center and angle.
+    float vtbx = ((float)xt - (float)xb) / width;
+    float vtby = ((float)yt - (float)yb) / height;
+    float vNorm = sqrt(vtbx * vtbx + vtby * vtby);
+    vtbx /= vNorm;
+    vtby /= vNorm;
+    os << " " << (float)xt / width << " " << (float)yt / height;
+    os << " " << (float)xb / width << " " << (float)yb / height;
+    float rx = (xb + vtbx * diameter)/ (float)width ;
+    float ry = (yb + vtby * diameter)/ (float)height ;
+    os << " " << rx << " " << ry;
+    os << '\n';
+  }
+  os.flush();
+}
+
+inline void printPath(std::ostream& os, const Laby& laby, const Ring& ring, const std::vector<PathStep>& path) {
+  printPath(os, laby.getWidth(), laby.getHeight(), ring.getDiameter(), path);
+}
+
+/**
+ * Converts a chain of states, given from the last state to the first one, to a path from the first step.
+ */
+inline void toPathSteps(const StateEncoding& states, const std::vector<size_t>& chain, std::vector<PathStep>& path) {
+  const Laby& laby = states.getLaby();
+  path.resize(chain.size());
+  for (size_t i = 0; i < chain.size(); ++i) {
+    size_t topPos, bottomPos;
+    PathStep& step = path[chain.size() - 1 - i];
+    states.posOf(chain[i], topPos, bottomPos);
+    step.time = chain.size() - 1 - i;
+    laby.posToCoords(topPos, step.topX, step.topY);
+    laby.posToCoords(bottomPos, step.bottomX, step.bottomY);
+  }
+}
+
+/**
+ * Called by the searches at each time step with the number of states in the frontier,
+ * or, for A*, at each new estimate with the number of expanded states.
+ * 'name' tells which of those it is. The search stops if it returns false.
+ * An empty Progress is not called.
+ */
+typedef std::function<bool(const char* name, unsigned time, size_t nodes)> Progress;
+
+//the frontier layers of the searches, passed in so that their memory can be reused
+template <class StateId>
+struct SearchLayers {
+  std::vector<StateId> current;
+  std::vector<StateId> next;
+  std::vector<StateId> reverse;
+};
+
+/**
+ * Appends the states from 'state' back to the origin it was reached from.
+ */
+template <class VisitedPositions>
+void chainToOrigin(const VisitedPositions& beenThere, size_t state, std::vector<size_t>& chain) {
+  for (; state != std::numeric_limits<size_t>::max(); state = beenThere.prevOf(state)) {
+    chain.push_back(state);
+  }
+}
+
+/**
+ * Expands all the states of 'layer', reached at 'time', and puts the new states in nextLayer.
+ * Stops as soon as stop(state) returns true for a new state, and returns that state.
+ * Otherwise, returns StateEncoding::InvalidState.
+ */
+template <class StateId, class VisitedPositions, class Stop, class Stats>
+size_t expandLayer(const StateEncoding& states, VisitedPositions& beenThere, const std::vector<StateId>& layer, std::vector<StateId>& nextLayer,
+                   unsigned time, Stop stop, Stats& stats) {
+  size_t found = StateEncoding::InvalidState;
+  stats.frontier(layer.size());
+  for (size_t i = 0; i < layer.size() && found == StateEncoding::InvalidState; ++i) {
+    size_t current = layer[i];
+    states.forEachValidMove(current, [&](size_t next, size_t, size_t, unsigned char move) {
+      if (found != StateEncoding::InvalidState) {
+        return;
+      }
+      if (beenThere(next, time + 1)) {
+        stats.visitedHit();
+        return;
+      }
+      nextLayer.push_back(next);
+      beenThere.set(next, time + 1, current, move);
+      if (stop(next)) {
+        found = next;
+      }
+    }, stats);
+  }
+  return found;
+}
+
+/**
+ * Breadth first search from the start position.
+ * Every move takes one time step, so the frontier is processed one time layer at a time:
+ * 'layer' holds the compact ids of the states reached at 'time', 'nextLayer' the ones reached at time + 1.
+ * Ties are broken the same way on every run: a layer is expanded in the order its states were reached,
+ * the moves of a state in move order, a new state keeps the first one it was reached from, and the search
+ * stops on the first exit reached. The path is a shortest one, but not always the same one as the
+ * std::priority_queue of the first version of this program, whose heap order picked among equal paths.
+ * StateId only needs to hold StateEncoding::size() values.
+ * For a possibility to be physically possible:
+ *  (1) the labyrinth must be empty on both top and bottom
+ *  (2) the pins must be separated by the correct distance
+ *  (3) the ring must not wipe through something other than InputSpace, only checked with --sweep.
+ * On success, 'path' gets the states from the exit back to the start.
+ * With a checkpoint, the search is saved at layer boundaries, and goes on from the
+ * saved layer if it was loaded (see SearchCheckpoint::resumed).
+ * The counters of the search are added to stats (see SearchStats).
+ */
+template <class StateId, class VisitedPositions, class Stats>
+bool search(const StateEncoding& states, VisitedPositions& beenThereBefore, size_t start, std::vector<size_t>& path,
+            SearchLayers<StateId>& layers, const Progress& progress, Stats& stats, SearchCheckpoint* checkpoint = NULL) {
+  const Laby& laby = states.getLaby();
+  std::vector<StateId>& layer = layers.current;
+  std::vector<StateId>& nextLayer = layers.next;
+  nextLayer.clear();
+  unsigned time = 0;
+  if (!checkpoint || !checkpoint->resumed(time)) {
+    layer.clear();
+    layer.push_back(start);
+    beenThereBefore.setOrigin(start);
+  }
+
+  auto isExit = [&](size_t state) {
+    size_t topPos, bottomPos;
+    states.posOf(state, topPos, bottomPos);
+    return laby.atTop(topPos) == Laby::Exit && laby.atBottom(bottomPos) == Laby::Exit;
+  };
+
+  size_t found = isExit(layer.front()) ? layer.front() : StateEncoding::InvalidState;
+  for (; !layer.empty() && found == StateEncoding::InvalidState; ++time) {
+    if (checkpoint) {
+      checkpoint->update(states, beenThereBefore, time, layer);
+    }
+    if (progress && !progress("time", time, layer.size())) {
+      return false;
+    }
+    found = expandLayer(states, beenThereBefore, layer, nextLayer, time, isExit, stats);
+    layer.swap(nextLayer);
+    nextLayer.clear();
+  }
+  if (found == StateEncoding::InvalidState) {
+    return false;
+  }
+  path.clear();
+  chainToOrigin(beenThereBefore, found, path);
+  return true;
+}
+
+/**
+ * Multi-threaded version of search(), one layer at a time:
+ *  - each thread expands its share of the layer, and claims the new states it finds
+ *    with an atomic test-and-set in a bitmap of the states of the next layer,
+ *  - the per-thread lists of claimed states are sorted and merged into the next layer,
+ *  - the parent of every new state is chosen as the first of its neighbours, in
+ *    move order, that belongs to the current layer. Those are the only neighbours
+ *    that have been visited, so the visited store can be read without locking.
+ * The result does not depend on which thread claims a state first, so the path is
+ * the same for any number of threads.
+ */
+template <class StateId, class Stats>
+bool parallelSearch(const StateEncoding& states, VisitedPositionsArray& beenThereBefore, size_t start, std::vector<size_t>& path,
+                    SearchLayers<StateId>& layers, WorkerPool& pool, const Progress& progress, Stats& stats,
+                    SearchCheckpoint* checkpoint = NULL) {
+  const Laby& laby = states.getLaby();
+  std::vector<Stats> threadStats(pool.size());
+  std::vector<uint64_t> claimed((states.size() + 63) / 64, 0);
+  std::vector<std::vector<StateId> > claimedBy(pool.size());
+  std::vector<size_t> listBegin(pool.size() + 1);
+  std::vector<size_t> firstExit(pool.size());
+  std::vector<StateId>& layer = layers.current;
+  std::vector<StateId>& nextLayer = layers.next;
+  unsigned time = 0;
+  if (!checkpoint || !checkpoint->resumed(time)) {
+    layer.clear();
+    layer.push_back(start);
+    beenThereBefore.setOrigin(start);
+  }
+
+  auto isExit = [&](size_t state) {
+    size_t topPos, bottomPos;
+    states.posOf(state, topPos, bottomPos);
+    return laby.atTop(topPos) == Laby::Exit && laby.atBottom(bottomPos) == Laby::Exit;
+  };
+
+  size_t found = isExit(layer.front()) ? layer.front() : StateEncoding::InvalidState;
+  for (; !layer.empty() && found == StateEncoding::InvalidState; ++time) {
+    if (checkpoint) {
+      checkpoint->update(states, beenThereBefore, time, layer);
+    }
+    if (progress && !progress("time", time, layer.size())) {
+      return false;
+    }
+    stats.frontier(layer.size());
+    pool.run([&](unsigned thread) {
+      std::vector<StateId>& mine = claimedBy[thread];
+      Stats& counters = threadStats[thread];
+      mine.clear();
+      size_t begin, end;
+      pool.chunk(thread, layer.size(), begin, end);
+      for (size_t i = begin; i < end; ++i) {
+        states.forEachValidMove(layer[i], [&](size_t next, size_t, size_t, unsigned char) {
+          uint64_t bit = (uint64_t)1 << (next & 63);
+          if (!beenThereBefore.seen(next) && !(__atomic_fetch_or(&claimed[next >> 6], bit, __ATOMIC_RELAXED) & bit)) {
+            mine.push_back(next);
+          } else {
+            counters.visitedHit();
+          }
+        }, counters);
+      }
+      std::sort(mine.begin(), mine.end());
+    });
+    for (unsigned i = 0; i < pool.size(); ++i) {
+      stats.add(threadStats[i]);
+      threadStats[i] = Stats();
+    }
+
+    //concatenate the sorted lists, then merge them pairwise
+    nextLayer.clear();
+    for (unsigned i = 0; i < pool.size(); ++i) {
+      listBegin[i] = nextLayer.size();
+      nextLayer.insert(nextLayer.end(), claimedBy[i].begin(), claimedBy[i].end());
+    }
+    listBegin[pool.size()] = nextLayer.size();
+    for (unsigned step = 1; step < pool.size(); step *= 2) {
+      pool.run([&](unsigned thread) {
+        if (thread % (2 * step) == 0 && thread + step < pool.size()) {
+          std::inplace_merge(nextLayer.begin() + listBegin[thread],
+                             nextLayer.begin() + listBegin[thread + step],
+                             nextLayer.begin() + listBegin[std::min(thread + 2 * step, pool.size())]);
+        }
+      });
+    }
+
+    pool.run([&](unsigned thread) {
+      size_t begin, end;
+      pool.chunk(thread, nextLayer.size(), begin, end);
+      firstExit[thread] = StateEncoding::InvalidState;
+      for (size_t i = begin; i < end; ++i) {
+        bool done = false;
+        states.forEachNeighbour(nextLayer[i], [&](size_t prev, unsigned char move) {
+          if (!done && beenThereBefore.seen(prev)) {
+            beenThereBefore.setMove(nextLayer[i], move);
+            done = true;
+          }
+        });
+        assert(done);
+        if (firstExit[thread] == StateEncoding::InvalidState && isExit(nextLayer[i])) {
+          firstExit[thread] = nextLayer[i];
+        }
+      }
+    });
+
+    pool.run([&](unsigned thread) {
+      size_t begin, end;
+      pool.chunk(thread, nextLayer.size(), begin, end);
+      for (size_t i = begin; i < end; ++i) {
+        size_t next = nextLayer[i];
+        beenThereBefore.markSeenAtomic(next);
+        __atomic_fetch_and(&claimed[next >> 6], ~((uint64_t)1 << (next & 63)), __ATOMIC_RELAXED);
+      }
+    });
+
+    for (unsigned i = 0; i < pool.size() && found == StateEncoding::InvalidState; ++i) {
+      found = firstExit[i];
+    }
+    layer.swap(nextLayer);
+  }
+  if (found == StateEncoding::InvalidState) {
+    return false;
+  }
+  path.clear();
+  chainToOrigin(beenThereBefore, found, path);
+  return true;
+}
+
+/**
+ * Writes state ids to a file, through a large buffer.
+ */
+template <class StateId>
+class StateFileWriter {
+  public:
+    static const size_t BufferSize = 1 << 17;
+
+    StateFileWriter(): _fd(-1), _ok(false), _count(0) {
+    }
+
+    ~StateFileWriter() {
+      close();
+    }
+
+    bool open(const std::string& filename) {
+      close();
+      _fd = ::open(filename.c_str(), O_WRONLY | O_CREAT | O_TRUNC, 0644);
+      _ok = _fd >= 0;
+      _count = 0;
+      _buffer.reserve(BufferSize);
+      return _ok;
+    }
+
+    void push(StateId state) {
+      _buffer.push_back(state);
+      ++_count;
+      if (_buffer.size() == BufferSize) {
+        flush();
+      }
+    }
+
+    //states written
+    size_t size() const {
+      return _count;
+    }
+
+    //false if a write failed
+    bool close() {
+      if (_fd >= 0) {
+        flush();
+        _ok = ::close(_fd) == 0 && _ok;
+        _fd = -1;
+      }
+      return _ok;
+    }
+
+  private:
+    void flush() {
+      const char* p = (const char*)_buffer.data();
+      size_t size = _buffer.size() * sizeof(StateId);
+      while (_ok && size > 0) {
+        ssize_t n = write(_fd, p, size);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        _ok = n > 0;
+        p += n;
+        size -= n;
+      }
+      _buffer.clear();
+    }
+
+    int _fd;
+    bool _ok;
+    size_t _count;
+    std::vector<StateId> _buffer;
+
+    StateFileWriter(const StateFileWriter&);
+    void operator=(const StateFileWriter&);
+};
+
+template <class StateId>
+const size_t StateFileWriter<StateId>::BufferSize;
+
+/**
+ * Reads the state ids of a file in order, through a large buffer.
+ */
+template <class StateId>
+class StateFileReader {
+  public:
+    static const size_t BufferSize = 1 << 17;
+
+    StateFileReader(): _fd(-1), _pos(0) {
+    }
+
+    ~StateFileReader() {
+      if (_fd >= 0) {
+        close(_fd);
+      }
+    }
+
+    //false if the file cannot be opened; the reader is then at its end
+    bool open(const std::string& filename) {
+      _fd = ::open(filename.c_str(), O_RDONLY);
+      if (_fd >= 0) {
+        posix_fadvise(_fd, 0, 0, POSIX_FADV_SEQUENTIAL);
+      }
+      _buffer.resize(BufferSize);
+      _buffer.clear();
+      refill();
+      return _fd >= 0;
+    }
+
+    bool atEnd() const {
+      return _pos == _buffer.size();
+    }
+
+    StateId value() const {
+      return _buffer[_pos];
+    }
+
+    void advance() {
+      if (++_pos == _buffer.size()) {
+        refill();
+      }
+    }
+
+  private:
+    void refill() {
+      _pos = 0;
+      _buffer.resize(BufferSize);
+      size_t size = 0;
+      while (_fd >= 0 && size < BufferSize * sizeof(StateId)) {
+        ssize_t n = read(_fd, (char*)_buffer.data() + size, BufferSize * sizeof(StateId) - size);
+        if (n < 0 && errno == EINTR) {
+          continue;
+        }
+        if (n <= 0) {
+          break;
+        }
+        size += n;
+      }
+      _buffer.resize(size / sizeof(StateId));
+    }
+
+    int _fd;
+    size_t _pos;
+    std::vector<StateId> _buffer;
+
+    StateFileReader(const StateFileReader&);
+    void operator=(const StateFileReader&);
+};
+
+template <class StateId>
+const size_t StateFileReader<StateId>::BufferSize;
+
+//true if the sorted file of state ids open on fd, of 'count' states, holds 'state'
+template <class StateId>
+bool stateFileContains(int fd, size_t count, size_t state) {
+  size_t begin = 0, end = count;
+  while (begin < end) {
+    size_t middle = begin + (end - begin) / 2;
+    StateId value;
+    if (pread(fd, &value, sizeof(value), middle * sizeof(StateId)) != sizeof(value)) {
+      return false;
+    }
+    if (value == state) {
+      return true;
+    }
+    if (value < state) {
+      begin = middle + 1;
+    } else {
+      end = middle;
+    }
+  }
+  return false;
+}
+
+/**
+ * Breadth first search with the layers on disk, for state spaces whose visited store
+ * does not fit in memory. Layer t is a sorted file of the states reached at time t:
+ *  - the states reached from layer t are collected in memory, up to 'memory' bytes at a
+ *    time, and each batch is sorted and written as a run file,
+ *  - the runs are merged into layer t + 1, dropping the states of layers t and t - 1.
+ *    Every move can be undone, so a neighbour of layer t is in layer t - 1, t or t + 1,
+ *    and those two layers are the only ones to check (delayed duplicate detection),
+ *  - the path is rebuilt backwards: the parent of a state of layer t + 1 is the first
+ *    of its neighbours, in move order, that is in layer t, like in parallelSearch().
+ * Files are only read and written sequentially, except for the binary searches of the
+ * path, and are named <dir>/laby<pid>.<name>. They are removed at the end.
+ */
+template <class StateId, class Stats>
+bool externalSearch(const StateEncoding& states, size_t start, std::vector<size_t>& path,
+                    const std::string& dir, size_t memory, const Progress& progress, Stats& stats) {
+  const Laby& laby = states.getLaby();
+  std::ostringstream prefix;
+  prefix << dir << "/laby" << getpid() << ".";
+  auto layerFile = [&](unsigned time) {
+    std::ostringstream filename;
+    filename << prefix.str() << "layer" << time;
+    return filename.str();
+  };
+  auto runFile = [&](unsigned run) {
+    std::ostringstream filename;
+    filename << prefix.str() << "run" << run;
+    return filename.str();
+  };
+  auto isExit = [&](size_t state) {
+    size_t topPos, bottomPos;
+    states.posOf(state, topPos, bottomPos);
+    return laby.atTop(topPos) == Laby::Exit && laby.atBottom(bottomPos) == Laby::Exit;
+  };
+
+  size_t found = isExit(start) ? start : StateEncoding::InvalidState;
+  bool failed = false;
+  bool stopped = false;
+  {
+    StateFileWriter<StateId> first;
+    first.open(layerFile(0));
+    first.push(start);
+    failed = !first.close();
+  }
+  std::vector<StateId> batch;
+  batch.reserve(std::max(memory / sizeof(StateId), (size_t)1));
+  unsigned time = 0;
+  for (size_t layerSize = 1; layerSize > 0 && found == StateEncoding::InvalidState && !failed; ++time) {
+    if (progress && !progress("time", time, layerSize)) {
+      stopped = true;
+      break;
+    }
+    //expand layer 'time' into sorted runs
+    stats.frontier(layerSize);
+    size_t generated = 0;
+    unsigned nRuns = 0;
+    auto writeRun = [&]() {
+      std::sort(batch.begin(), batch.end());
+      StateFileWriter<StateId> run;
+      run.open(runFile(nRuns++));
+      for (size_t i = 0; i < batch.size(); ++i) {
+        if (i == 0 || batch[i] != batch[i - 1]) {
+          run.push(batch[i]);
+        }
+      }
+      failed = !run.close() || failed;
+      batch.clear();
+    };
+    StateFileReader<StateId> layer;
+    failed = !layer.open(layerFile(time)) || failed;
+    for (; !layer.atEnd(); layer.advance()) {
+      states.forEachValidMove(layer.value(), [&](size_t next, size_t, size_t, unsigned char) {
+        batch.push_back(next);
+        ++generated;
+        if (batch.size() == batch.capacity()) {
+          writeRun();
+        }
+      }, stats);
+    }
+    if (!batch.empty()) {
+      writeRun();
+    }
+
+    //merge the runs into layer time + 1, without the states of layers time and time - 1
+    std::vector<std::unique_ptr<StateFileReader<StateId> > > runs(nRuns);
+    typedef std::pair<StateId, unsigned> Head;
+    std::priority_queue<Head, std::vector<Head>, std::greater<Head> > heads;
+    for (unsigned i = 0; i < nRuns; ++i) {
+      runs[i].reset(new StateFileReader<StateId>());
+      failed = !runs[i]->open(runFile(i)) || failed;
+      if (!runs[i]->atEnd()) {
+        heads.push(Head(runs[i]->value(), i));
+      }
+    }
+    StateFileReader<StateId> previous, current;
+    if (time > 0) {
+      previous.open(layerFile(time - 1));
+    }
+    current.open(layerFile(time));
+    StateFileWriter<StateId> next;
+    failed = !next.open(layerFile(time + 1)) || failed;
+    while (!heads.empty() && found == StateEncoding::InvalidState) {
+      StateId state = heads.top().first;
+      while (!heads.empty() && heads.top().first == state) {
+        unsigned i = heads.top().second;
+        heads.pop();
+        runs[i]->advance();
+        if (!runs[i]->atEnd()) {
+          heads.push(Head(runs[i]->value(), i));
+        }
+      }
+      for (; !previous.atEnd() && previous.value() < state; previous.advance()) {
+      }
+      for (; !current.atEnd() && current.value() < state; current.advance()) {
+      }
+      if ((!previous.atEnd() && previous.value() == state) || (!current.atEnd() && current.value() == state)) {
+        continue;
+      }
+      next.push(state);
+      if (isExit(state)) {
+        found = state;
+      }
+    }
+    layerSize = next.size();
+    stats.visitedHit(found == StateEncoding::InvalidState ? generated - layerSize : 0);
+    failed = !next.close() || failed;
+    runs.clear();
+    for (unsigned i = 0; i < nRuns; ++i) {
+      unlink(runFile(i).c_str());
+    }
+  }
+  if (failed) {
+    std::cerr << "Cannot write the layers of the search to '" << dir << "'" << std::endl;
+  }
+
+  //rebuild the path backwards from the exit, time being the time of the exit
+  if (found != StateEncoding::InvalidState && !failed && !stopped) {
+    path.clear();
+    path.push_back(found);
+    for (unsigned t = time; t-- > 0;) {
+      int fd = ::open(layerFile(t).c_str(), O_RDONLY);
+      struct stat st;
+      size_t count = fd >= 0 && fstat(fd, &st) == 0 ? st.st_size / sizeof(StateId) : 0;
+      bool done = false;
+      states.forEachNeighbour(path.back(), [&](size_t prev, unsigned char) {
+        if (!done && stateFileContains<StateId>(fd, count, prev)) {
+          path.push_back(prev);
+          done = true;
+        }
+      });
+      if (fd >= 0) {
+        close(fd);
+      }
+      if (!done) {
+        std::cerr << "Cannot read the layers of the search from '" << dir << "'" << std::endl;
+        failed = true;
+        break;
+      }
+    }
+  }
+  for (unsigned t = 0; t <= time; ++t) {
+    unlink(layerFile(t).c_str());
+  }
+  return found != StateEncoding::InvalidState && !failed && !stopped;
+}
+
+/**
+ * A* search, using max(distance from the top pin to an exit, distance from the bottom pin to an exit)
+ * as the estimate of the remaining time: each pin moves by at most one cell per time step,
+ * so it never overestimates, and it changes by at most one between neighbour states.
+ * A state can be reached again later with a smaller time, so the visited store
+ * must record times (VisitedPositionsHashMap does).
+ * 'expanded' gets the number of expanded states.
+ */
+template <class VisitedPositions, class Stats>
+bool aStarSearch(const StateEncoding& states, VisitedPositions& beenThereBefore, size_t start, std::vector<size_t>& path,
+                 size_t& expanded, const Progress& progress, Stats& stats) {
+  const Laby& laby = states.getLaby();
+  std::vector<unsigned> topDist, bottomDist;
+  laby.exitDistances(true, topDist);
+  laby.exitDistances(false, bottomDist);
+
+  std::priority_queue<Node> queue;
+  queue.push(Node(start, 0, 0));
+  beenThereBefore.setOrigin(start);
+
+  unsigned lastEstimate = 0;
+  expanded = 0;
+  while (!queue.empty()) {
+    Node current = queue.top();
+    queue.pop();
+    if (current.time > 0 && beenThereBefore(current.state, current.time - 1)) {
+      //reached faster after this node was queued
+      continue;
+    }
+    if (lastEstimate != current.estimate) {
+      lastEstimate = current.estimate;
+      if (progress && !progress("estimate", current.estimate, expanded)) {
+        return false;
+      }
+    }
+    size_t topPos, bottomPos;
+    states.posOf(current.state, topPos, bottomPos);
+    if (laby.atTop(topPos) == Laby::Exit && laby.atBottom(bottomPos) == Laby::Exit) {
+      path.clear();
+      chainToOrigin(beenThereBefore, current.state, path);
+      return true;
+    }
+    ++expanded;
+    states.forEachValidMove(current.state, [&](size_t next, size_t nextTopPos, size_t nextBottomPos, unsigned char move) {
+      if (!beenThereBefore(next, current.time + 1)) {
+        unsigned remaining = std::max(topDist[nextTopPos], bottomDist[nextBottomPos]);
+        if (remaining != Laby::UnreachableDistance) {
+          beenThereBefore.set(next, current.time + 1, current.state, move);
+          queue.push(Node(next, current.time + 1, current.time + 1 + remaining));
+        }
+      } else {
+        stats.visitedHit();
+      }
+    }, stats);
+    stats.frontier(queue.size());
+  }
+  return false;
+}
+
+/**
+ * Bidirectional breadth first search: a forward search from the start position and a
+ * reverse search from all the valid positions where both pins are on an Exit cell.
+ * The moves are symmetric, so the reverse search uses the same moves as the forward one.
+ * The search with the smallest frontier is grown by one layer at a time until one
+ * of them reaches a state that the other one has already visited.
+ * At that point, both have reached it at the smallest possible time, so joining the
+ * two parent chains gives a shortest path.
+ */
+template <class StateId, class VisitedPositions, class Stats>
+bool bidirectionalSearch(const StateEncoding& states, const Ring& ring, VisitedPositions& forward, VisitedPositions& reverse, size_t start,
+                         std::vector<size_t>& path, SearchLayers<StateId>& layers, const Progress& progress, Stats& stats) {
+  const Laby& laby = states.getLaby();
+  const RingOffsets& offsets = states.getOffsets();
+  std::vector<StateId>& forwardLayer = layers.current;
+  std::vector<StateId>& reverseLayer = layers.reverse;
+  std::vector<StateId>& nextLayer = layers.next;
+  forwardLayer.clear();
+  reverseLayer.clear();
+  nextLayer.clear();
+  forwardLayer.push_back(start);
+  forward.setOrigin(start);
+
+  size_t meeting = StateEncoding::InvalidState;
+  for (size_t topPos = 0; topPos < laby.getCellCount(); ++topPos) {
+    if (laby.atTop(topPos) != Laby::Exit) {
+      continue;
+    }
+    unsigned x, y;
+    laby.posToCoords(topPos, x, y);
+    for (unsigned i = 0; i < offsets.size(); ++i) {
+      int xb = x + offsets.dx(i);
+      int yb = y + offsets.dy(i);
+      if (xb < 0 || xb >= (int)laby.getWidth() || yb < 0 || yb >= (int)laby.getHeight()) {
+        continue;
+      }
+      size_t bottomPos = laby.coordsToPos(xb, yb);
+      if (laby.atBottom(bottomPos) == Laby::Exit && laby.validate(topPos, bottomPos, ring)) {
+        size_t state = states.stateOf(topPos, bottomPos);
+        reverseLayer.push_back(state);
+        reverse.setOrigin(state);
+      }
+    }
+  }
+  if (reverse(start, 0)) {
+    meeting = start;
+  }
+
+  /*
+   * The start position does not have to be valid, so the reverse search cannot reach it.
+   * That does not matter: the forward search, which has the smallest frontier, expands it
+   * first, so a path goes through one of the start neighbours visited by both searches.
+   */
+  auto seenByReverse = [&](size_t state) {
+    return reverse(state, std::numeric_limits<unsigned>::max());
+  };
+  auto seenByForward = [&](size_t state) {
+    return forward(state, std::numeric_limits<unsigned>::max());
+  };
+
+  unsigned forwardTime = 0;
+  unsigned reverseTime = 0;
+  while (meeting == StateEncoding::InvalidState && !forwardLayer.empty() && !reverseLayer.empty()) {
+    if (forwardLayer.size() <= reverseLayer.size()) {
+      if (progress && !progress("forward time", forwardTime, forwardLayer.size())) {
+        return false;
+      }
+      meeting = expandLayer(states, forward, forwardLayer, nextLayer, forwardTime, seenByReverse, stats);
+      forwardLayer.swap(nextLayer);
+      ++forwardTime;
+    } else {
+      if (progress && !progress("reverse time", reverseTime, reverseLayer.size())) {
+        return false;
+      }
+      meeting = expandLayer(states, reverse, reverseLayer, nextLayer, reverseTime, seenByForward, stats);
+      reverseLayer.swap(nextLayer);
+      ++reverseTime;
+    }
+    nextLayer.clear();
+  }
+  if (meeting == StateEncoding::InvalidState) {
+    return false;
+  }
+
+  //path from the exit to the meeting point, then from the meeting point to the start
+  path.clear();
+  chainToOrigin(reverse, meeting, path);
+  std::reverse(path.begin(), path.end());
+  path.pop_back();
+  chainToOrigin(forward, meeting, path);
+  return true;
+}
+
+/**
+ * The pins start in the top left corner, the bottom pin pinDist below the top one.
+ * Returns StateEncoding::InvalidState if the ring does not allow that, or if the labyrinth is too small.
+ */
+inline size_t startState(const StateEncoding& states, const Ring& ring) {
+  const Laby& laby = states.getLaby();
+  if (laby.getWidth() == 0 || laby.getHeight() <= (unsigned)ring.getPinDistance()) {
+    return StateEncoding::InvalidState;
+  }
+  return states.stateOf(laby.coordsToPos(0, 0), laby.coordsToPos(0, (unsigned)ring.getPinDistance()));
+}
+
+/**
+ * Prunes the labyrinth for the ring with these offsets (see Laby::prune), with the pins on the start position of startState.
+ * Returns false when there is no path. A start position that does not fit is left for the search to report.
+ */
+inline bool pruneLaby(Laby& laby, const Ring& ring, const RingOffsets& offsets) {
+  if (laby.getWidth() == 0 || laby.getHeight() <= (unsigned)ring.getPinDistance()) {
+    return true;
+  }
+  return laby.prune(offsets, laby.coordsToPos(0, 0), laby.coordsToPos(0, (unsigned)ring.getPinDistance()));
+}
+
+inline bool pruneLaby(Laby& laby, const Ring& ring) {
+  return pruneLaby(laby, ring, RingOffsets(ring));
+}
+
+/**
+ * Solves labyrinths in-process, returning the path as PathSteps.
+ * The visited stores, frontier layers and threads are kept from one solve() to the next,
+ * so solving many labyrinths with one solver only allocates for the largest one.
+ * A solver must only be used by one thread at a time, except for cancel().
+ */
+class LabySolver {
+  public:
+    enum Method {
+      BreadthFirst,
+      Bidirectional,
+      AStar //always uses the Hash store, which records times
+    };
+    enum Store {
+      Dense,
+      Hash,
+      Disk //only used by BreadthFirst, see externalSearch
+    };
+    enum Result {Found, NotFound, InvalidStart, Cancelled, BadCheckpoint};
+
+    LabySolver(): _method(BreadthFirst), _store(Dense), _sweep(false), _nThreads(0), _cancelled(false), _expanded(0), _collectStats(false),
+                  _diskDir("."), _diskMemory((size_t)1 << 30), _resume(false), _badCheckpoint(false), _levels(0), _band(4) {
+    }
+
+    void setMethod(Method method) {
+      _method = method;
+    }
+
+    void setStore(Store store) {
+      _store = store;
+    }
+
+    //where the Disk store puts its files, and how much memory it sorts at a time
+    void setDiskStore(const std::string& dir, size_t memory) {
+      _diskDir = dir;
+      _diskMemory = memory;
+    }
+
+    //see StateEncoding
+    void setSweep(bool sweep) {
+      _sweep = sweep;
+    }
+
+    /**
+     * Any number of threads, 1 included, uses parallelSearch(), whose path does not depend on it;
+     * 0 (the default) uses search(). Only used by BreadthFirst with the Dense store.
+     */
+    void setThreads(unsigned nThreads) {
+      _nThreads = nThreads;
+    }
+
+    void setProgress(const Progress& progress) {
+      _progress = progress;
+    }
+
+    //counts what the searches do, see getStats(); off by default, and then it costs nothing
+    void setStats(bool collect) {
+      _collectStats = collect;
+    }
+
+    //the counters of the current solve(), which the Progress can read, or of the last one
+    const SearchStats& getStats() const {
+      return _stats;
+    }
+
+    /**
+     * Saves BreadthFirst searches with the Dense store to 'filename' every 'interval' seconds
+     * (see SearchCheckpoint). With 'resume', a search goes on from the one saved in the file
+     * if there is one; solve() returns BadCheckpoint if it was saved for another search.
+     * An empty filename turns checkpoints off.
+     */
+    void setCheckpoint(const std::string& filename, unsigned interval, bool resume) {
+      _checkpoint.reset(filename.empty() ? NULL : new SearchCheckpoint(filename, interval));
+      _resume = resume;
+    }
+
+    /**
+     * Coarse to fine solves of a Laby: the labyrinth is halved 'levels' times (see Laby::halved), with the
+     * pin distance, diameter and tolerance, and solved on the coarsest level first. Each finer level is then solved
+     * with the maps cut down to the cells less than 'band' cells away from the pins of the coarser path,
+     * and with all its cells if there is no path in the band or on the coarser level.
+     * The path comes from the full labyrinth, but is only the shortest within the band.
+     * 0 levels (the default) solves the labyrinth as it is. Not for checkpoints, which hold one search.
+     */
+    void setLevels(unsigned levels, unsigned band) {
+      _levels = levels;
+      _band = band;
+    }
+
+    //stops the current solve() as soon as possible, or the next one if none is running; can be called from any thread
+    void cancel() {
+      __atomic_store_n(&_cancelled, true, __ATOMIC_RELAXED);
+    }
+
+    Result solve(const Laby& laby, const Ring& ring, std::vector<PathStep>& path) {
+      if (_levels > 0) {
+        return solveLevels(laby, ring, path);
+      }
+      return solve(laby, ring, RingOffsets(ring), path);
+    }
+
+    //with the offsets of ring, for callers that share them between rings (see RingOffsets)
+    Result solve(const Laby& laby, const Ring& ring, const RingOffsets& offsets, std::vector<PathStep>& path) {
+      StateEncoding states(laby, offsets, _sweep);
+      return solve(states, ring, path);
+    }
+
+    //with tables built for ring beforehand; the sweep check is on if it is on in states
+    Result solve(const StateEncoding& states, const Ring& ring, std::vector<PathStep>& path) {
+      path.clear();
+      size_t start = startState(states, ring);
+      if (start == StateEncoding::InvalidState) {
+        return InvalidStart;
+      }
+      bool stopped = false;
+      _stats = SearchStats();
+      Progress progress = [&](const char* name, unsigned time, size_t nodes) {
+        if (_collectStats) {
+          _stats.storeBytes = storeBytes();
+        }
+        stopped = __atomic_exchange_n(&_cancelled, false, __ATOMIC_RELAXED) || (_progress && !_progress(name, time, nodes));
+        return !stopped;
+      };
+      bool found;
+      NoSearchStats noStats;
+      if (states.size() <= std::numeric_limits<uint32_t>::max()) {
+        found = _collectStats ? solve(states, ring, start, _layers32, progress, _stats) : solve(states, ring, start, _layers32, progress, noStats);
+      } else {
+        found = _collectStats ? solve(states, ring, start, _layers64, progress, _stats) : solve(states, ring, start, _layers64, progress, noStats);
+      }
+      if (_collectStats) {
+        _stats.storeBytes = storeBytes();
+      }
+      if (_checkpoint) {
+        _checkpoint->wait();
+      }
+      if (_badCheckpoint) {
+        _badCheckpoint = false;
+        return BadCheckpoint;
+      }
+      if (stopped) {
+        return Cancelled;
+      }
+      if (!found) {
+        return NotFound;
+      }
+      toPathSteps(states, _chain, path);
+      return Found;
+    }
+
+    //states expanded by the last AStar solve()
+    size_t getExpanded() const {
+      return _expanded;
+    }
+
+  private:
+    /**
+     * See setLevels. Levels with no path are pruned away (see pruneLaby) before searching.
+     * The Progress gets a "level" call after each level, with the number of steps of its path (0 if none).
+     */
+    Result solveLevels(const Laby& laby, const Ring& ring, std::vector<PathStep>& path) {
+      std::vector<Laby> coarse;
+      for (unsigned k = 0; k < _levels; ++k) {
+        coarse.push_back((k == 0 ? laby : coarse.back()).halved());
+      }
+      path.clear();
+      for (unsigned k = _levels + 1; k-- > 0;) {
+        Ring levelRing(ldexp(ring.getPinDistance(), -k), ldexp(ring.getDiameter(), -k), ldexp(ring.getTolerance(), -k));
+        const Laby& level = k > 0 ? coarse[k - 1] : laby;
+        Result result = NotFound;
+        if (!path.empty()) {
+          Laby band(level);
+          BitPlane topCells, bottomCells;
+          bandAround(band, path, topCells, bottomCells);
+          band.keepCells(topCells, bottomCells);
+          path.clear();
+          if (pruneLaby(band, levelRing)) {
+            result = solve(band, levelRing, RingOffsets(levelRing), path);
+          }
+        }
+        if (result == NotFound && (k == 0 || pruneLaby(coarse[k - 1], levelRing))) {
+          result = solve(level, levelRing, RingOffsets(levelRing), path);
+        }
+        if (result == Cancelled || result == BadCheckpoint || k == 0) {
+          return result;
+        }
+        if (_progress && !_progress("level", k, path.empty() ? 0 : path.size() - 1)) {
+          return Cancelled;
+        }
+      }
+      return NotFound;
+    }
+
+    //the cells of laby less than _band cells away from the pins of path, a path on the labyrinth halved once
+    void bandAround(const Laby& laby, const std::vector<PathStep>& path, BitPlane& topCells, BitPlane& bottomCells) const {
+      topCells.resize(laby.getCellCount());
+      bottomCells.resize(laby.getCellCount());
+      int w = laby.getWidth(), h = laby.getHeight(), band = _band;
+      for (size_t i = 0; i < path.size(); ++i) {
+        for (unsigned top = 0; top < 2; ++top) {
+          int x = 2 * (top ? path[i].topX : path[i].bottomX);
+          int y = 2 * (top ? path[i].topY : path[i].bottomY);
+          for (int yy = std::max(y - band, 0); yy <= std::min(y + 1 + band, h - 1); ++yy) {
+            for (int xx = std::max(x - band, 0); xx <= std::min(x + 1 + band, w - 1); ++xx) {
+              (top ? topCells : bottomCells).set(laby.coordsToPos(xx, yy), true);
+            }
+          }
+        }
+      }
+    }
+
+    //memory of the visited stores and layers
+    size_t storeBytes() const {
+      return _dense[0].sizeInBytes() + _dense[1].sizeInBytes() + _hash[0].sizeInBytes() + _hash[1].sizeInBytes()
+        + (_layers32.current.capacity() + _layers32.next.capacity() + _layers32.reverse.capacity()) * sizeof(uint32_t)
+        + (_layers64.current.capacity() + _layers64.next.capacity() + _layers64.reverse.capacity()) * sizeof(uint64_t);
+    }
+
+    template <class StateId, class Stats>
+    bool solve(const StateEncoding& states, const Ring& ring, size_t start, SearchLayers<StateId>& layers, const Progress& progress, Stats& stats) {
+      if (_method == AStar) {
+        _hash[0].reset(states);
+        return aStarSearch(states, _hash[0], start, _chain, _expanded, progress, stats);
+      } else if (_store == Hash) {
+        return solve(states, ring, start, _hash, layers, progress, stats);
+      } else if (_store == Disk) {
+        return externalSearch<StateId>(states, start, _chain, _diskDir, _diskMemory, progress, stats);
+      } else if (_method == BreadthFirst && _nThreads > 0) {
+        if (!_pool || _pool->size() != _nThreads) {
+          _pool.reset(new WorkerPool(_nThreads));
+        }
+        _dense[0].reset(states);
+        if (!resume(states, layers)) {
+          return false;
+        }
+        return parallelSearch(states, _dense[0], start, _chain, layers, *_pool, progress, stats, _checkpoint.get());
+      } else {
+        return solve(states, ring, start, _dense, layers, progress, stats);
+      }
+    }
+
+    //loads the checkpoint into _dense[0] if resuming and there is one
+    template <class StateId>
+    bool resume(const StateEncoding& states, SearchLayers<StateId>& layers) {
+      if (!_checkpoint || !_resume || access(_checkpoint->getFilename().c_str(), F_OK) != 0) {
+        return true;
+      }
+      _badCheckpoint = !_checkpoint->load(states, _dense[0], layers.current, &std::cerr);
+      return !_badCheckpoint;
+    }
+
+    template <class StateId, class VisitedPositions, class Stats>
+    bool solve(const StateEncoding& states, const Ring& ring, size_t start, VisitedPositions* stores, SearchLayers<StateId>& layers,
+               const Progress& progress, Stats& stats) {
+      stores[0].reset(states);
+      if (_method == Bidirectional) {
+        stores[1].reset(states);
+        return bidirectionalSearch(states, ring, stores[0], stores[1], start, _chain, layers, progress, stats);
+      }
+      if (_store == Dense && !resume(states, layers)) {
+        return false;
+      }
+      return search(states, stores[0], start, _chain, layers, progress, stats, _store == Dense ? _checkpoint.get() : NULL);
+    }
+
+    Method _method;
+    Store _store;
+    bool _sweep;
+    unsigned _nThreads;
+    Progress _progress;
+    bool _cancelled;
+    size_t _expanded;
+    bool _collectStats;
+    SearchStats _stats;
+    VisitedPositionsArray _dense[2];
+    VisitedPositionsHashMap _hash[2];
+    SearchLayers<uint32_t> _layers32;
+    SearchLayers<uint64_t> _layers64;
+    std::vector<size_t> _chain;
+    std::unique_ptr<WorkerPool> _pool;
+    std::string _diskDir;
+    size_t _diskMemory;
+    std::unique_ptr<SearchCheckpoint> _checkpoint;
+    bool _resume;
+    bool _badCheckpoint;
+    unsigned _levels;
+    unsigned _band;
+
+    LabySolver(const LabySolver&);
+    void operator=(const LabySolver&);
+};
+
+#endif
@@ -24,195 +24,482 @@
 #define PGMRW_HPP_
 
 #include <fstream>
+#include <vector>
 #include <ostream>
+#include <iterator>
+#include <algorithm>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <cassert>
 
+/**
+ * A whole file in memory: mapped if it is a regular file, else read at once.
+ */
+class MappedFile {
+  public:
+  MappedFile(): _map(NULL), _size(0) {
+  }
+
+  ~MappedFile() {
+    if (_map) {
+      munmap(_map, _size);
+    }
+  }
+
+  bool open(const char * filename) {
+    int fd = ::open(filename, O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+    struct stat st;
+    if (fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+      _size = st.st_size;
+      _map = mmap(NULL, _size, PROT_READ, MAP_PRIVATE, fd, 0);
+      if (_map == MAP_FAILED) {
+        _map = NULL;
+      }
+    }
+    if (!_map) {
+      //not a regular file: read it at once
+      unsigned char buf[1 << 16];
+      ssize_t n;
+      while ((n = ::read(fd, buf, sizeof(buf))) > 0) {
+        _contents.insert(_contents.end(), buf, buf + n);
+      }
+      _size = _contents.size();
+    }
+    close(fd);
+    return true;
+  }
+
+  const unsigned char* begin() const {
+    return _map ? (const unsigned char*)_map : _contents.data();
+  }
+
+  const unsigned char* end() const {
+    return begin() + _size;
+  }
+
+  private:
+  void* _map;
+  size_t _size;
+  std::vector<unsigned char> _contents;
+
+  MappedFile(const MappedFile&);
+  void operator=(const MappedFile&);
+};
+
+/**
+ * Reads P1 to P6 files. The file is mapped in memory (or read at once if it cannot be mapped),
+ * and decoded a row at a time into RGB triples.
+ * P1 and P4 bitmaps give black (0) for 1 and white (255) for 0.
+ * Samples are scaled to [0, 255] if the maximum value of the file is not 255.
+ */
 class PnmReader {
   public:
   static bool read(const char * filename, unsigned &w, unsigned &h, std::vector<unsigned char> &data, std::ostream *err = NULL) {
-    std::ifstream ifs ( filename , std::ifstream::in );
-    if(!ifs.good()) {
+    data.resize(0);
+    return readRows(filename, _sizeSetter(w, h, data), _rowCopier(w, data), err);
+  }
+
+  static bool read(std::ifstream& ifs, unsigned &w, unsigned &h, std::vector<unsigned char> &data, std::ostream *err = NULL) {
+    data.resize(0);
+    std::vector<unsigned char> contents((std::istreambuf_iterator<char>(ifs)), std::istreambuf_iterator<char>());
+    Input in = {contents.data(), contents.data() + contents.size()};
+    return _read(in, _sizeSetter(w, h, data), _rowCopier(w, data), err);
+  }
+
+  /**
+   * Calls onSize(w, h) once the header is read, then onRow(y, rgb) for each row from top to bottom,
+   * where rgb points to the 3 * w bytes of the row. rgb is only valid during the call.
+   * Returns false if the file cannot be read, or if onSize returns false.
+   */
+  template <class SizeF, class RowF>
+  static bool readRows(const char * filename, SizeF onSize, RowF onRow, std::ostream *err = NULL) {
+    MappedFile file;
+    if (!file.open(filename)) {
       if (err) {
         *err << "Cannot open file '" << filename << "' for reading." << std::endl;
       }
       return false;
     }
+    Input in = {file.begin(), file.end()};
+    return _read(in, onSize, onRow, err);
+  }
+
+  private:
+  struct Input {
+    const unsigned char* pos;
+    const unsigned char* end;
+  };
+
+  //callbacks for the vector interface
+  struct SizeSetter {
+    unsigned &w;
+    unsigned &h;
+    std::vector<unsigned char> &data;
+    bool operator()(unsigned width, unsigned height) const {
+      w = width;
+      h = height;
+      data.resize(3 * (size_t)w * h);
+      return true;
+    }
+  };
 
-    if (!read(ifs, w, h, data, err)) {
+  struct RowCopier {
+    const unsigned &w;
+    std::vector<unsigned char> &data;
+    void operator()(unsigned y, const unsigned char* rgb) const {
+      std::copy(rgb, rgb + 3 * w, data.begin() + 3 * (size_t)w * y);
+    }
+  };
+
+  static SizeSetter _sizeSetter(unsigned &w, unsigned &h, std::vector<unsigned char> &data) {
+    SizeSetter setter = {w, h, data};
+    return setter;
+  }
+
+  static RowCopier _rowCopier(const unsigned &w, std::vector<unsigned char> &data) {
+    RowCopier copier = {w, data};
+    return copier;
+  }
+
+  static bool _isSpace(unsigned char c) {
+    return c == ' ' || c == '\t' || c == '\n' || c == '\r' || c == '\v' || c == '\f';
+  }
+
+  //skips whitespace and comments
+  static void _skipSpace(Input& in) {
+    while (in.pos != in.end) {
+      if (*in.pos == '#') {
+        while (in.pos != in.end && *in.pos != '\n') {
+          ++in.pos;
+        }
+      } else if (_isSpace(*in.pos)) {
+        ++in.pos;
+      } else {
+        return;
+      }
+    }
+  }
+
+  static bool _readUnsigned(Input& in, unsigned &v) {
+    _skipSpace(in);
+    if (in.pos == in.end || *in.pos < '0' || *in.pos > '9') {
       return false;
     }
+    v = 0;
+    while (in.pos != in.end && *in.pos >= '0' && *in.pos <= '9') {
+      v = 10 * v + (*in.pos - '0');
+      ++in.pos;
+    }
+    return true;
+  }
 
-    ifs.close();
+  static bool _readHeader(Input& in, char type, unsigned &width, unsigned &height, unsigned &maxVal, std::ostream *err) {
+    if (!_readUnsigned(in, width)) {
+      if (err) {
+        *err << "Cannot read PNM width." << std::endl;
+      }
+      return false;
+    }
+    if (!_readUnsigned(in, height)) {
+      if (err) {
+        *err << "Cannot read PNM height." << std::endl;
+      }
+      return false;
+    }
+    maxVal = 1;
+    if (type != '1' && type != '4' && (!_readUnsigned(in, maxVal) || maxVal == 0 || maxVal > 65535)) {
+      if (err) {
+        *err << "Cannot read PNM depth." << std::endl;
+      }
+      return false;
+    }
+    if (type >= '4') {
+      //a single whitespace before the binary data
+      if (in.pos == in.end || !_isSpace(*in.pos)) {
+        if (err) {
+          *err << "Not a PNM file." << std::endl;
+        }
+        return false;
+      }
+      ++in.pos;
+    }
     return true;
   }
 
-  static bool read(std::ifstream& ifs, unsigned &w, unsigned &h, std::vector<unsigned char> &data, std::ostream *err = NULL) {
-    data.resize(0);
-    char buf[bufSize];
-    ifs.getline(buf, bufSize);
-    if (buf[0] != 'P') {
+  template <class SizeF, class RowF>
+  static bool _read(Input& in, SizeF onSize, RowF onRow, std::ostream *err) {
+    if (in.end - in.pos < 2 || in.pos[0] != 'P' || in.pos[1] < '1' || in.pos[1] > '6') {
       if (err) {
         *err << "Not a PNM file." << std::endl;
       }
       return false;
     }
-    switch (buf[1]) {
-      case '1':
-        return _read<AsciiPBM>(ifs, w, h, data, err);
-      case '2':
-        return _read<AsciiPGM>(ifs, w, h, data, err);
-      case '3':
-        return _read<AsciiPPM>(ifs, w, h, data, err);
-      case '4':
-        return _read<BinPGM>(ifs, w, h, data, err); //FIXME
-      case '5':
-        return _read<BinPGM>(ifs, w, h, data, err);
-      case '6':
-        return _read<BinPPM>(ifs, w, h, data, err);
-      default:
+    char type = in.pos[1];
+    in.pos += 2;
+    unsigned w, h, maxVal;
+    if (!_readHeader(in, type, w, h, maxVal, err) || !onSize(w, h)) {
+      return false;
+    }
+    std::vector<unsigned char> row(3 * (size_t)w);
+    for (unsigned y = 0; y < h; ++y) {
+      const unsigned char* rgb = row.data();
+      bool ok;
+      switch (type) {
+        case '1':
+          ok = _readAsciiPBM(in, w, row);
+          break;
+        case '2':
+          ok = _readAscii(in, w, 1, maxVal, row);
+          break;
+        case '3':
+          ok = _readAscii(in, w, 3, maxVal, row);
+          break;
+        case '4':
+          ok = _readBinPBM(in, w, row);
+          break;
+        case '5':
+          ok = _readBin(in, w, 1, maxVal, row);
+          break;
+        default:
+          if (maxVal == 255) {
+            //the row is already in the file
+            ok = in.end - in.pos >= (ptrdiff_t)row.size();
+            rgb = in.pos;
+            in.pos += ok ? row.size() : 0;
+          } else {
+            ok = _readBin(in, w, 3, maxVal, row);
+          }
+          break;
+      }
+      if (!ok) {
         if (err) {
-          *err << "Not a PNM file." << std::endl;
+          *err << "PNM file is truncated." << std::endl;
         }
         return false;
+      }
+      onRow(y, rgb);
     }
+    return true;
   }
 
-  private:
-    enum PixType {AsciiPBM, AsciiPGM, AsciiPPM, BinPBM, BinPGM, BinPPM};
+  static unsigned char _scale(unsigned v, unsigned maxVal) {
+    if (maxVal == 255) {
+      return (unsigned char)v;
+    }
+    return v >= maxVal ? 255 : (unsigned char)((v * 255 + maxVal / 2) / maxVal);
+  }
 
-  static bool _readCommentWidthHeight(std::ifstream& ifs, unsigned &width, unsigned &height, std::ostream *err) {
-    //read comments
-    char buf[bufSize];
-    while (ifs.peek() == '#') {
-      ifs.getline(buf, bufSize);
+  //one digit per pixel, the whitespace between them is optional
+  static bool _readAsciiPBM(Input& in, unsigned w, std::vector<unsigned char> &row) {
+    for (unsigned x = 0; x < w; ++x) {
+      _skipSpace(in);
+      if (in.pos == in.end || (*in.pos != '0' && *in.pos != '1')) {
+        return false;
+      }
+      unsigned char v = *in.pos++ == '1' ? 0 : 255;
+      row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = v;
     }
-    ifs >> width;
-    if (ifs.eof() || ifs.fail()) {
-      if (err) {
-        *err << "Cannot read PNM width." << std::endl;
+    return true;
+  }
+
+  //channels is 1 for gray, 3 for RGB
+  static bool _readAscii(Input& in, unsigned w, unsigned channels, unsigned maxVal, std::vector<unsigned char> &row) {
+    for (unsigned x = 0; x < w; ++x) {
+      for (unsigned c = 0; c < channels; ++c) {
+        unsigned v;
+        if (!_readUnsigned(in, v)) {
+          return false;
+        }
+        row[3 * x + c] = _scale(v, maxVal);
       }
+      if (channels == 1) {
+        row[3 * x + 1] = row[3 * x + 2] = row[3 * x];
+      }
+    }
+    return true;
+  }
+
+  //rows are padded to a whole byte, most significant bit first
+  static bool _readBinPBM(Input& in, unsigned w, std::vector<unsigned char> &row) {
+    size_t rowBytes = (w + 7) / 8;
+    if (in.end - in.pos < (ptrdiff_t)rowBytes) {
+      return false;
+    }
+    for (unsigned x = 0; x < w; ++x) {
+      unsigned char v = (in.pos[x / 8] >> (7 - x % 8)) & 1 ? 0 : 255;
+      row[3 * x] = row[3 * x + 1] = row[3 * x + 2] = v;
+    }
+    in.pos += rowBytes;
+    return true;
+  }
+
+  //samples take two bytes, most significant first, if maxVal > 255
+  static bool _readBin(Input& in, unsigned w, unsigned channels, unsigned maxVal, std::vector<unsigned char> &row) {
+    unsigned sampleBytes = maxVal > 255 ? 2 : 1;
+    if (in.end - in.pos < (ptrdiff_t)(sampleBytes * channels * w)) {
       return false;
     }
-    ifs >> height;
-    if (ifs.eof() || ifs.fail()) {
+    for (unsigned x = 0; x < w; ++x) {
+      for (unsigned c = 0; c < channels; ++c) {
+        unsigned v = sampleBytes == 2 ? (in.pos[0] << 8) | in.pos[1] : in.pos[0];
+        in.pos += sampleBytes;
+        row[3 * x + c] = _scale(v, maxVal);
+      }
+      if (channels == 1) {
+        row[3 * x + 1] = row[3 * x + 2] = row[3 * x];
+      }
+    }
+    return true;
+  }
+};
+
+/**
+ * Writes a binary PNM file a row at a time, through a large buffer.
+ * Rows hold one byte per channel: 3 per pixel for PPM, 1 for PGM and PBM.
+ * PBM pixels are black for 0 and white otherwise, and are packed 8 to a byte.
+ */
+class PnmWriter {
+  public:
+  enum Format {PBM, PGM, PPM};
+
+  PnmWriter(): _w(0), _h(0), _format(PPM), _rows(0) {
+  }
+
+  ~PnmWriter() {
+    close();
+  }
+
+  static unsigned channels(Format format) {
+    return format == PPM ? 3 : 1;
+  }
+
+  bool open(const char * filename, unsigned w, unsigned h, Format format, std::ostream *err = NULL) {
+    _ofs.open(filename, std::ofstream::out | std::ofstream::binary);
+    if(!_ofs.good()) {
       if (err) {
-        *err << "Cannot read PNM width." << std::endl;
+        *err << "Cannot open file '" << filename << "' for writing." << std::endl;
       }
       return false;
     }
-    unsigned depth;
-    ifs >> depth;
-    if (ifs.eof() || ifs.fail()) {
+    _w = w;
+    _h = h;
+    _format = format;
+    _rows = 0;
+    _buffer.clear();
+    _buffer.reserve(bufSize);
+    _ofs << (format == PBM ? "P4\n" : (format == PGM ? "P5\n" : "P6\n")) << w << " " << h << (format == PBM ? "\n" : "\n255\n");
+    return true;
+  }
+
+  //row holds channels(format) * w bytes
+  void writeRow(const unsigned char* row) {
+    assert(_rows < _h);
+    if (_format == PBM) {
+      for (unsigned x = 0; x < _w; x += 8) {
+        unsigned char bits = 0;
+        for (unsigned k = 0; k < 8 && x + k < _w; ++k) {
+          bits |= (row[x + k] ? 0 : 1) << (7 - k);
+        }
+        _buffer.push_back(bits);
+      }
+    } else {
+      _buffer.insert(_buffer.end(), row, row + channels(_format) * _w);
+    }
+    if (_buffer.size() >= bufSize) {
+      flush();
+    }
+    ++_rows;
+  }
+
+  void flush() {
+    _ofs.write((const char*)_buffer.data(), _buffer.size());
+    _buffer.clear();
+  }
+
+  //returns false if not all rows were written, or if writing failed
+  bool close(std::ostream *err = NULL) {
+    if (!_ofs.is_open()) {
+      return true;
+    }
+    flush();
+    _ofs.close();
+    if (_rows != _h || _ofs.fail()) {
       if (err) {
-        *err << "Cannot read PNM depth." << std::endl;
+        *err << "PnmWriter: wrote " << _rows << " rows out of " << _h << "." << std::endl;
       }
       return false;
     }
-    ifs.getline(buf, bufSize); //read the remaining of the line (\n)
     return true;
   }
 
-  //binary RGB
-  template<PixType type>
-  static bool _read(std::ifstream& ifs, unsigned &w, unsigned &h, std::vector<unsigned char> &data, std::ostream *err = NULL) {
-    if (!_readCommentWidthHeight(ifs, w, h, err)) {
+  /**
+   * Writes a whole file, calling rowOf(y, row) to fill each row from top to bottom.
+   * row has room for channels(format) * w bytes, and is reused from one row to the next.
+   */
+  template <class RowF>
+  static bool write(const char * filename, unsigned w, unsigned h, Format format, RowF rowOf, std::ostream *err = NULL) {
+    PnmWriter writer;
+    if (!writer.open(filename, w, h, format, err)) {
       return false;
     }
-    data.reserve(w * h * 3);
-    for (unsigned i = 0; i < w * h; ++i) {
-      _readPixel<type>(ifs, data);
+    std::vector<unsigned char> row(channels(format) * (size_t)w);
+    for (unsigned y = 0; y < h; ++y) {
+      rowOf(y, row.data());
+      writer.writeRow(row.data());
     }
-    return true;
+    return writer.close(err);
   }
 
-  template<PixType type>
-  static void _readPixel(std::ifstream& ifs, std::vector<unsigned char> &data);
+  private:
+  unsigned _w;
+  unsigned _h;
+  Format _format;
+  unsigned _rows;
+  std::ofstream _ofs;
+  std::vector<unsigned char> _buffer;
+
+  static const size_t bufSize = 1 << 20;
 
-  static const size_t bufSize = 512;
+  PnmWriter(const PnmWriter&);
+  void operator=(const PnmWriter&);
 };
 
-template <>
-void PnmReader::_readPixel<PnmReader::AsciiPBM>(std::ifstream& ifs, std::vector<unsigned char> &data) {
-  unsigned v;
-  ifs >> v;
-  data.push_back(v ? 255 : 0);
-  data.push_back(v ? 255 : 0);
-  data.push_back(v ? 255 : 0);
-}
-
-template <>
-void PnmReader::_readPixel<PnmReader::AsciiPGM>(std::ifstream& ifs, std::vector<unsigned char> &data) {
-  unsigned v;
-  ifs >> v;
-  data.push_back((unsigned char)v);
-  data.push_back((unsigned char)v);
-  data.push_back((unsigned char)v);
-}
-
-template <>
-void PnmReader::_readPixel<PnmReader::AsciiPPM>(std::ifstream& ifs, std::vector<unsigned char> &data) {
-  unsigned v;
-  ifs >> v;
-  data.push_back((unsigned char)v);
-  ifs >> v;
-  data.push_back((unsigned char)v);
-  ifs >> v;
-  data.push_back((unsigned char)v);
-}
-
-template <>
-void PnmReader::_readPixel<PnmReader::BinPGM>(std::ifstream& ifs, std::vector<unsigned char> &data) {
-  unsigned char v;
-  ifs.read((char*)&v, 1);
-  data.push_back(v);
-  data.push_back(v);
-  data.push_back(v);
-}
-
-template <>
-void PnmReader::_readPixel<PnmReader::BinPPM>(std::ifstream& ifs, std::vector<unsigned char> &data) {
-  unsigned char v;
-  ifs.read((char*)&v, 1);
-  data.push_back(v);
-  ifs.read((char*)&v, 1);
-  data.push_back(v);
-  ifs.read((char*)&v, 1);
-  data.push_back(v);
-}
-
 class PpmWriter {
   public:
   static bool write(const char * filename, unsigned w, unsigned h, const std::vector<unsigned char> &data, std::ostream *err = NULL) {
-    std::ofstream ofs ( filename , std::ifstream::out );
-    if(!ofs.good()) {
-      if (err) {
-        *err << "Cannot open file '" << filename << "' for writing." << std::endl;
-      }
+    if (!_checkSize(w, h, data, err)) {
       return false;
     }
+    return PnmWriter::write(filename, w, h, PnmWriter::PPM, [&](unsigned y, unsigned char* row) {
+      std::copy(data.begin() + 3 * (size_t)w * y, data.begin() + 3 * (size_t)w * (y + 1), row);
+    }, err);
+  }
 
-    if (!write(ofs, w, h, data, err)) {
+  static bool write(std::ofstream& ofs, unsigned w, unsigned h, const std::vector<unsigned char> &data, std::ostream *err = NULL) {
+    if (!_checkSize(w, h, data, err)) {
       return false;
     }
-
-    ofs.close();
+    ofs << "P6\n" << w << " " << h << "\n255\n";
+    ofs.write((const char*)data.data(), data.size());
     return true;
   }
 
-  static bool write(std::ofstream& ofs, unsigned w, unsigned h, const std::vector<unsigned char> &data, std::ostream *err = NULL) {
+  private:
+  static bool _checkSize(unsigned w, unsigned h, const std::vector<unsigned char> &data, std::ostream *err) {
     if (data.size() != w * h * 3) {
       if (err) {
         *err << "PpmWriter: Data has incorrect size (" << data.size() << " but image size is " << w << "x" << h << ")." << std::endl;
       }
       return false;
     }
-    ofs << "P6\n" << w << " " << h << "\n255\n";
-    for (size_t i=0; i<data.size(); ++i) {
-      ofs.write((const char*)&data[i], 1);
-    }
     return true;
   }
-
 };
 
 
-#endif
\ No newline at end of file
+#endif
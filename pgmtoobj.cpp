@@ -22,111 +22,354 @@
 
 #include <iostream>
 #include <vector>
+#include <string>
+#include <thread>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "pgm.hpp"
 
 #define THICKNESS 0.05
 
-void vertex(std::ostream &ofs, float x, float y, float z, unsigned &nVerts) {
-  ofs << "v " << x << " " << y << " " << z << std::endl;
-  ++nVerts;
-}
-
-void triangle(std::ostream &ofs, int a, int b, int c, unsigned nTris) {
-  ofs << "f " << (a + 1) << " " << (b + 1) << " " << (c + 1) << std::endl;
-  ++nTris;
-}
-
-void quad(std::ostream &ofs, unsigned a, unsigned b, unsigned c, unsigned d, unsigned nTris) {
-  triangle(ofs, a, b, c, nTris);
-  triangle(ofs, c, d, a, nTris);
-}
+//a wall rectangle, as the indices of its corners (x0, y0), (x0, y1), (x1, y1), (x1, y0)
+struct Quad {
+  unsigned a;
+  unsigned b;
+  unsigned c;
+  unsigned d;
+};
 
-int main(int argc, char **argv) {
-  if (argc < 2) {
-    std::cerr << "Usage: pgmtoobj <input.ppm>" << std::endl;
-    return 0;
+/**
+ * The mesh of a band of rows. Vertex indices start at 0 in each band.
+ * vertices only holds the vertices that were not written yet: the first one has index
+ * nVerts - vertices.size() / 3.
+ */
+struct MeshChunk {
+  MeshChunk(): nVerts(0) {
   }
 
-  std::vector<unsigned char> data;
-  unsigned w, h;
-  if (!PnmReader::read(argv[1], w, h, data, &std::cerr)) {
-    return 0;
+  void clear() {
+    vertices.clear();
+    quads.clear();
   }
-  std::cerr << "image size is " << w << "x" << h << std::endl;
 
-  std::ofstream vfs ( "tmp_verts.txt" , std::ofstream::out );
-  if(!vfs.good()) {
-    std::cerr << "Cannot open tmp file tmp_verts.txt for writing" << std::endl;
-    return 0;
-  }
-  std::ofstream tfs ( "tmp_tris.txt" , std::ofstream::out );
-  if(!tfs.good()) {
-    std::cerr << "Cannot open tmp file tmp_tris.txt for writing" << std::endl;
-    return 0;
-  }
+  std::vector<float> vertices; //x, y, z
+  std::vector<Quad> quads;
+  unsigned nVerts;
+};
 
-  unsigned nVerts = 0;
-  unsigned nTris = 0;
+/**
+ * The walls of one layer, as rectangles, built a row at a time:
+ * a run of wall pixels continues the rectangle of the same run in the previous row,
+ * or starts a new one. A rectangle becomes a quad once the next row does not continue it.
+ * Only the corners of the rectangles are vertices, and the corners that rectangles ending and
+ * starting on the same line share are added once, so only O(width) memory is needed.
+ * Quads only use vertices added before them, so a chunk can be written and cleared at any time.
+ */
+class LayerMesh {
+  public:
+    LayerMesh(MeshChunk &chunk, unsigned channel, float z)
+     : _chunk(chunk), _channel(channel), _z(z), _w(0), _h(0) {
+    }
 
-  //write grid of vertices
-  for (unsigned y = 0; y < h + 1; ++y) {
-    for (unsigned x = 0; x < w + 1; ++x) {
-      vertex(vfs, x / (float)w       , y / (float)h      ,  THICKNESS, nVerts);
+    void resize(unsigned w, unsigned h) {
+      _w = w;
+      _h = h;
+      _lineVertex.assign(w + 1, 0);
+      _lineStamp.assign(w + 1, 0);
+      _rects.clear();
     }
-  }
-  for (unsigned y = 0; y < h + 1; ++y) {
-    for (unsigned x = 0; x < w + 1; ++x) {
-      vertex(vfs, x / (float)w       , y / (float)h      ,  -THICKNESS, nVerts);
+
+    //rgb holds the 3 * w bytes of row y, a channel < 128 is a wall
+    void addRow(unsigned y, const unsigned char* rgb) {
+      _runs.clear();
+      for (unsigned x = 0; x < _w; ++x) {
+        if (rgb[3 * x + _channel] < 128) {
+          Run run;
+          run.x0 = x;
+          while (x < _w && rgb[3 * x + _channel] < 128) {
+            ++x;
+          }
+          run.x1 = x;
+          _runs.push_back(run);
+        }
+      }
+
+      //both lists are sorted by x0
+      _continued.assign(_runs.size(), (size_t)-1);
+      size_t j = 0;
+      for (size_t i = 0; i < _rects.size(); ++i) {
+        const Rect& rect = _rects[i];
+        while (j < _runs.size() && _runs[j].x0 < rect.x0) {
+          ++j;
+        }
+        if (j < _runs.size() && _runs[j].x0 == rect.x0 && _runs[j].x1 == rect.x1) {
+          _continued[j] = i;
+        } else {
+          close(rect, y);
+        }
+      }
+
+      _nextRects.clear();
+      for (j = 0; j < _runs.size(); ++j) {
+        if (_continued[j] != (size_t)-1) {
+          _nextRects.push_back(_rects[_continued[j]]);
+        } else {
+          Rect rect;
+          rect.x0 = _runs[j].x0;
+          rect.x1 = _runs[j].x1;
+          rect.a = lineVertex(rect.x0, y);
+          rect.d = lineVertex(rect.x1, y);
+          _nextRects.push_back(rect);
+        }
+      }
+      _rects.swap(_nextRects);
     }
-  }
 
-  //write quads
-  for (unsigned y = 0; y < h; ++y) {
-    for (unsigned x = 0; x < w; ++x) {
-      unsigned a = (w+1) * y       + x;
-      unsigned b = (w+1) * (y + 1) + x;
-      unsigned c = (w+1) * (y + 1) + x + 1;
-      unsigned d = (w+1) * y       + x + 1;
-      if (data[3 * (w * y + x)] < 128) {
-        quad(tfs, a, b, c, d, nTris);
+    //closes the rectangles that reach line y, the end of the rows added so far
+    void finish(unsigned y) {
+      for (size_t i = 0; i < _rects.size(); ++i) {
+        close(_rects[i], y);
       }
-      if (data[3 * (w * y + x) + 1] < 128) {
-        quad(tfs, a + (w+1)*(h+1), b + (w+1)*(h+1), c + (w+1)*(h+1), d + (w+1)*(h+1), nTris);
+      _rects.clear();
+    }
+
+  private:
+    struct Run {
+      unsigned x0;
+      unsigned x1;
+    };
+
+    //pixels [x0, x1) from the row where a (x0, y0) and d (x1, y0) are
+    struct Rect {
+      unsigned x0;
+      unsigned x1;
+      unsigned a;
+      unsigned d;
+    };
+
+    void close(const Rect& rect, unsigned y) {
+      Quad quad = {rect.a, lineVertex(rect.x0, y), lineVertex(rect.x1, y), rect.d};
+      _chunk.quads.push_back(quad);
+    }
+
+    //index of the vertex (x, y), added if it is not yet on line y
+    unsigned lineVertex(unsigned x, unsigned y) {
+      if (_lineStamp[x] != y + 1) {
+        _lineStamp[x] = y + 1;
+        _lineVertex[x] = _chunk.nVerts++;
+        _chunk.vertices.push_back(x / (float)_w);
+        _chunk.vertices.push_back(y / (float)_h);
+        _chunk.vertices.push_back(_z);
       }
+      return _lineVertex[x];
     }
-  }
 
-  vfs.close();
-  tfs.close();
+    MeshChunk &_chunk;
+    unsigned _channel;
+    float _z;
+    unsigned _w;
+    unsigned _h;
+    std::vector<unsigned> _lineVertex;
+    std::vector<unsigned> _lineStamp;
+    std::vector<Rect> _rects;
+    std::vector<Rect> _nextRects;
+    std::vector<Run> _runs;
+    std::vector<size_t> _continued;
+};
 
-  {
-    char buf[256];
-    //std::cout << "#clement courbet" << std::endl << nVerts << " " << nTris << std::endl;
-    std::ifstream vfs ( "tmp_verts.txt" , std::ifstream::in );
-    if(!vfs.good()) {
-      std::cerr << "Cannot open tmp file tmp_verts.txt for writing" << std::endl;
-      return 0;
+/**
+ * Writes chunks as text OBJ, binary PLY or binary STL.
+ * OBJ faces may come after any vertex they use, so OBJ chunks can be written as they are made.
+ * PLY and STL need the counts first, then (for PLY) all vertices before all faces.
+ * Binary formats are little endian, like the machines we run on.
+ * Each quad is two triangles, except in PLY which has quad faces.
+ */
+class MeshWriter {
+  public:
+    enum Format {OBJ, PLY, STL};
+
+    MeshWriter(std::ostream &os, Format format): _os(os), _format(format) {
     }
-    while (vfs.getline(buf, 256)) {
-      std::cout << buf << std::endl;
+
+    void header(unsigned nVerts, unsigned nQuads) {
+      if (_format == PLY) {
+        char buf[256];
+        int n = snprintf(buf, sizeof(buf), "ply\nformat binary_little_endian 1.0\n"
+                         "element vertex %u\nproperty float x\nproperty float y\nproperty float z\n"
+                         "element face %u\nproperty list uchar uint vertex_indices\nend_header\n", nVerts, nQuads);
+        _os.write(buf, n);
+      } else if (_format == STL) {
+        char buf[80];
+        memset(buf, 0, sizeof(buf));
+        strncpy(buf, "pgmtoobj", sizeof(buf));
+        _os.write(buf, sizeof(buf));
+        uint32_t nTris = 2 * nQuads;
+        _os.write((const char*)&nTris, 4);
+      }
     }
-    vfs.close();
-    std::ifstream tfs ( "tmp_tris.txt" , std::ifstream::in );
-    if(!tfs.good()) {
-      std::cerr << "Cannot open tmp file tmp_tris.txt for writing" << std::endl;
-      return 0;
+
+    void vertices(const MeshChunk &chunk) {
+      _buf.clear();
+      if (_format == OBJ) {
+        for (size_t i = 0; i < chunk.vertices.size(); i += 3) {
+          char line[64];
+          int n = snprintf(line, sizeof(line), "v %g %g %g\n", chunk.vertices[i], chunk.vertices[i + 1], chunk.vertices[i + 2]);
+          _buf.append(line, n);
+        }
+      } else if (_format == PLY) {
+        _buf.append((const char*)chunk.vertices.data(), chunk.vertices.size() * sizeof(float));
+      }
+      _os.write(_buf.data(), _buf.size());
     }
-    while (tfs.getline(buf, 256)) {
-      std::cout << buf << std::endl;
+
+    //the vertices of the chunk are numbered from base, the ones still in the chunk are used for STL
+    void faces(const MeshChunk &chunk, unsigned base) {
+      _buf.clear();
+      for (size_t i = 0; i < chunk.quads.size(); ++i) {
+        const Quad &q = chunk.quads[i];
+        if (_format == OBJ) {
+          char line[128];
+          int n = snprintf(line, sizeof(line), "f %u %u %u\nf %u %u %u\n",
+                           base + q.a + 1, base + q.b + 1, base + q.c + 1,
+                           base + q.c + 1, base + q.d + 1, base + q.a + 1);
+          _buf.append(line, n);
+        } else if (_format == PLY) {
+          uint32_t face[4] = {base + q.a, base + q.b, base + q.c, base + q.d};
+          _buf.push_back(4);
+          _buf.append((const char*)face, sizeof(face));
+        } else {
+          stlTriangle(chunk, q.a, q.b, q.c);
+          stlTriangle(chunk, q.c, q.d, q.a);
+        }
+      }
+      _os.write(_buf.data(), _buf.size());
     }
-    tfs.close();
-  }
 
+  private:
+    //(a, b, c) turns clockwise seen from above
+    void stlTriangle(const MeshChunk &chunk, unsigned a, unsigned b, unsigned c) {
+      float data[12] = {0.0f, 0.0f, -1.0f};
+      unsigned corners[3] = {a, b, c};
+      for (unsigned k = 0; k < 3; ++k) {
+        memcpy(&data[3 + 3 * k], &chunk.vertices[3 * corners[k]], 3 * sizeof(float));
+      }
+      _buf.append((const char*)data, sizeof(data));
+      _buf.append(2, '\0');
+    }
 
-  return 0;
+    std::ostream &_os;
+    Format _format;
+    std::string _buf;
+};
+
+//meshes rows [yBegin, yEnd) of both layers
+void meshBand(const std::vector<unsigned char> &data, unsigned w, unsigned h, unsigned yBegin, unsigned yEnd, MeshChunk &chunk) {
+  //red is the top layer, green the bottom one
+  LayerMesh top(chunk, 0, THICKNESS);
+  LayerMesh bottom(chunk, 1, -THICKNESS);
+  top.resize(w, h);
+  bottom.resize(w, h);
+  for (unsigned y = yBegin; y < yEnd; ++y) {
+    top.addRow(y, &data[3 * (size_t)w * y]);
+    bottom.addRow(y, &data[3 * (size_t)w * y]);
+  }
+  top.finish(yEnd);
+  bottom.finish(yEnd);
 }
 
+int main(int argc, char **argv) {
+  const char* input = NULL;
+  std::string format = "obj";
+  unsigned nThreads = 1;
+  for (int i = 1; i < argc; ++i) {
+    std::string arg(argv[i]);
+    if (arg.compare(0, 9, "--format=") == 0) {
+      format = arg.substr(9);
+    } else if (arg == "-j" && i + 1 < argc) {
+      nThreads = atoi(argv[++i]);
+    } else {
+      input = argv[i];
+    }
+  }
+  if (!input || (format != "obj" && format != "ply" && format != "stl") || nThreads == 0) {
+    std::cerr << "Usage: pgmtoobj [--format=obj|ply|stl] [-j threads] <input.ppm>" << std::endl;
+    return 0;
+  }
+  std::ios_base::sync_with_stdio(false);
+  MeshWriter writer(std::cout, format == "obj" ? MeshWriter::OBJ : (format == "ply" ? MeshWriter::PLY : MeshWriter::STL));
 
+  unsigned nVerts = 0;
+  unsigned nQuads = 0;
+  if (format == "obj" && nThreads == 1) {
+    //stream rows in and chunks out
+    MeshChunk chunk;
+    LayerMesh top(chunk, 0, THICKNESS);
+    LayerMesh bottom(chunk, 1, -THICKNESS);
+    unsigned h = 0;
+    auto onSize = [&](unsigned width, unsigned height) {
+      std::cerr << "image size is " << width << "x" << height << std::endl;
+      h = height;
+      top.resize(width, height);
+      bottom.resize(width, height);
+      return true;
+    };
+    auto onRow = [&](unsigned y, const unsigned char* rgb) {
+      top.addRow(y, rgb);
+      bottom.addRow(y, rgb);
+      if (chunk.vertices.size() + chunk.quads.size() > (1 << 16)) {
+        nQuads += chunk.quads.size();
+        writer.vertices(chunk);
+        writer.faces(chunk, 0);
+        chunk.clear();
+      }
+    };
+    if (!PnmReader::readRows(input, onSize, onRow, &std::cerr)) {
+      return 0;
+    }
+    top.finish(h);
+    bottom.finish(h);
+    nQuads += chunk.quads.size();
+    writer.vertices(chunk);
+    writer.faces(chunk, 0);
+    nVerts = chunk.nVerts;
+  } else {
+    //one band of rows per thread, joined once all are done
+    std::vector<unsigned char> data;
+    unsigned w, h;
+    if (!PnmReader::read(input, w, h, data, &std::cerr)) {
+      return 0;
+    }
+    std::cerr << "image size is " << w << "x" << h << std::endl;
+    std::vector<MeshChunk> chunks(nThreads);
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < nThreads; ++i) {
+      threads.push_back(std::thread(meshBand, std::cref(data), w, h,
+                                    (unsigned)((uint64_t)h * i / nThreads), (unsigned)((uint64_t)h * (i + 1) / nThreads),
+                                    std::ref(chunks[i])));
+    }
+    for (unsigned i = 0; i < nThreads; ++i) {
+      threads[i].join();
+      nQuads += chunks[i].quads.size();
+    }
+    std::vector<unsigned> base(nThreads);
+    for (unsigned i = 0; i < nThreads; ++i) {
+      base[i] = nVerts;
+      nVerts += chunks[i].nVerts;
+    }
+    writer.header(nVerts, nQuads);
+    for (unsigned i = 0; i < nThreads; ++i) {
+      writer.vertices(chunks[i]);
+    }
+    for (unsigned i = 0; i < nThreads; ++i) {
+      writer.faces(chunks[i], base[i]);
+    }
+  }
+  std::cout.flush();
+  std::cerr << nVerts << " vertices, " << 2 * nQuads << " triangles" << std::endl;
 
+  return 0;
+}